@@ -20,6 +20,7 @@
 
 #include "lib_rom_bin.h"
 #include "export-dialog.h"
+#include "rom_format.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -35,10 +36,60 @@ struct rom_bin_data {
     int       * response;
     GtkWidget * image_mode_combo;
     int       * image_mode;
+    GtkWidget * offset_entry;       // open mode only
+    GtkWidget * length_entry;
+    long int  * p_offset;
+    long int  * p_length;
+    GtkWidget * patch_toggle;       // save mode only
+    int       * p_patch_in_place;
 };
 
 void on_response(GtkDialog *, gint, gpointer);
 
+
+// Reads a byte count from an entry (decimal, or hex with 0x), 0 if it's empty or invalid
+static long int entry_get_byte_count(GtkWidget * entry)
+{
+    const gchar * p_text;
+    gchar       * p_end;
+    gint64        value;
+
+    p_text = gtk_entry_get_text(GTK_ENTRY(entry));
+    value  = g_ascii_strtoll(p_text, &p_end, 0);
+
+    if ((p_end == p_text) || (*p_end != '\0') || (value < 0)) {
+        if (*p_text != '\0')
+            g_print("Ignoring invalid byte count: %s\n", p_text);
+        return 0;
+    }
+
+    return (long int)value;
+}
+
+
+// Adds a labeled text entry for a byte count to the box
+static GtkWidget * add_byte_count_entry(GtkWidget * vbox, const gchar * label_text)
+{
+    GtkWidget * hbox;
+    GtkWidget * label;
+    GtkWidget * entry;
+
+    hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 2);
+    gtk_widget_show(hbox);
+
+    label = gtk_label_new(label_text);
+    gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 2);
+    gtk_widget_show(label);
+
+    entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(entry), "0");
+    gtk_box_pack_end(GTK_BOX(hbox), entry, FALSE, FALSE, 2);
+    gtk_widget_show(entry);
+
+    return entry;
+}
+
 void on_response(GtkDialog * dialog,
                  gint response_id,
                  gpointer user_data)
@@ -49,42 +100,30 @@ void on_response(GtkDialog * dialog,
     // Connect to the combo box pointer
     // Then get currently selected string from combo box
     GtkWidget * image_mode_combo = data->image_mode_combo;
+    int mode;
     gchar *string = gtk_combo_box_text_get_active_text( GTK_COMBO_BOX_TEXT(image_mode_combo) );
 
     // TODO: Using the dialog on import is disabled for now- remove support for import prompting?
-    // TODO: convert strings to centralized definition
     // Match the string up to an output mode
-    if (!(g_strcmp0(string, "1bpp NES")))
-        *(data->image_mode) = BIN_MODE_NES_1BPP;
-    else if (!(g_strcmp0(string, "2bpp NES")))
-        *(data->image_mode) = BIN_MODE_NES_2BPP;
-    else if (!(g_strcmp0(string, "2bpp SNES/GB")))
-        *(data->image_mode) = BIN_MODE_SNESGB_2BPP;
-    else if (!(g_strcmp0(string, "2bpp NGPC")))
-        *(data->image_mode) = BIN_MODE_NGPC_2BPP;
-
-    else if (!(g_strcmp0(string, "3bpp SNES")))
-        *(data->image_mode) = BIN_MODE_SNES_3BPP;
-
-
-    else if (!(g_strcmp0(string, "4bpp GBA")))
-        *(data->image_mode) = BIN_MODE_GBA_4BPP;
-    else if (!(g_strcmp0(string, "4bpp SNES")))
-        *(data->image_mode) = BIN_MODE_SNES_4BPP;
-    else if (!(g_strcmp0(string, "4bpp GG/SMS/WSC")))
-        *(data->image_mode) = BIN_MODE_GGSMSWSC_4BPP;
-    else if (!(g_strcmp0(string, "4bpp GEN")))
-        *(data->image_mode) = BIN_MODE_GENS_4BPP;
-
-    else if (!(g_strcmp0(string, "8bpp GBA")))
-        *(data->image_mode) = BIN_MODE_GBA_8BPP;
-    else if (!(g_strcmp0(string, "8bpp SNES")))
-        *(data->image_mode) = BIN_MODE_SNES_8BPP;
-    else
-        *(data->image_mode) = -1; //
+    *(data->image_mode) = -1;
+
+    for (mode=0; mode < romimg_format_count(); mode++) {
+        if (!(g_strcmp0(string, romimg_format_get(mode)->NAME)))
+            *(data->image_mode) = mode;
+    }
 
     g_print( "Selected: >> %s <<\n", ( string ? string : "NULL" ) );
 
+    // Part of the file to open
+    if (NULL != data->p_offset) {
+        *(data->p_offset) = entry_get_byte_count(data->offset_entry);
+        *(data->p_length) = entry_get_byte_count(data->length_entry);
+    }
+
+    // Write only the loaded part of the file back
+    if (NULL != data->p_patch_in_place)
+        *(data->p_patch_in_place) = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(data->patch_toggle)) ? 1 : 0;
+
     // Free string
     g_free( string );
 
@@ -96,7 +135,11 @@ void on_response(GtkDialog * dialog,
         *(data->response) = 1;
 }
 
-int export_dialog(int * image_mode, const gchar * name)
+// Shows the format dialog. When opening a file (p_offset and p_length not NULL)
+// it also asks for the part of the file to load, length 0 meaning up to the end.
+// When exporting (p_patch_in_place not NULL) it asks whether to only patch
+// the tiles back into the part of the existing file they were loaded from
+int export_dialog(int * image_mode, long int * p_offset, long int * p_length, int * p_patch_in_place, const gchar * name)
 {
     int response = 0;
     struct rom_bin_data data;
@@ -105,15 +148,19 @@ int export_dialog(int * image_mode, const gchar * name)
     GtkWidget * label;
 
     GtkWidget * image_mode_combo;
+    GtkWidget * offset_entry = NULL;
+    GtkWidget * length_entry = NULL;
+    GtkWidget * patch_toggle = NULL;
+    int mode;
 
 
     // Create the export dialog
 
-    if(!strcmp(name, SAVE_PROCEDURE)) {
-        // If Exporting use the export dialog convenience function
+    if(NULL == p_offset) {
+        // If Exporting (as a rom or a patch) use the export dialog convenience function
         dialog = gimp_export_dialog_new("ROM bin",
                                         BINARY_NAME,
-                                        SAVE_PROCEDURE);
+                                        name);
     }
     else {
 
@@ -155,21 +202,8 @@ int export_dialog(int * image_mode, const gchar * name)
     image_mode_combo = gtk_combo_box_text_new();
 
     // Add the mode select entries
-    // TODO: convert strings to centralized definition
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "1bpp NES");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "2bpp NES");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "2bpp SNES/GB");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "2bpp NGPC");
-
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "3bpp SNES");
-
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "4bpp GBA");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "4bpp SNES");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "4bpp GG/SMS/WSC");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "4bpp GEN");
-
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "8bpp GBA");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), "8bpp SNES");
+    for (mode=0; mode < romimg_format_count(); mode++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(image_mode_combo), romimg_format_get(mode)->NAME);
 
     // Select default value
     // TODO: try to auto-detect image mode based on number of colors? (export only)
@@ -180,12 +214,34 @@ int export_dialog(int * image_mode, const gchar * name)
     gtk_widget_show(image_mode_combo);
 
 
+    // Offset and length of the data to open, for pulling
+    // a single graphics bank out of a bigger rom
+    if (NULL != p_offset) {
+        offset_entry = add_byte_count_entry(vbox, "Start offset (bytes, 0x for hex):");
+        length_entry = add_byte_count_entry(vbox, "Length (bytes, 0 for the rest of the file):");
+    }
+
+    // Patching only rewrites the tiles, so the rest of a big rom file never gets touched
+    if (NULL != p_patch_in_place) {
+        patch_toggle = gtk_check_button_new_with_label("Patch in place: only write the tiles back over\nthe part of the existing file they were loaded from");
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(patch_toggle), *p_patch_in_place ? TRUE : FALSE);
+        gtk_box_pack_start(GTK_BOX(vbox), patch_toggle, FALSE, FALSE, 2);
+        gtk_widget_show(patch_toggle);
+    }
+
+
     // TODO: set Export as default focused button
 
     // Connect the controls to the response signal
     data.response      = &response;
     data.image_mode_combo = image_mode_combo;
     data.image_mode = image_mode;
+    data.offset_entry = offset_entry;
+    data.length_entry = length_entry;
+    data.p_offset     = p_offset;
+    data.p_length     = p_length;
+    data.patch_toggle     = patch_toggle;
+    data.p_patch_in_place = p_patch_in_place;
 
     g_signal_connect(dialog, "response", G_CALLBACK(on_response),   &data);
     g_signal_connect(dialog, "destroy",  G_CALLBACK(gtk_main_quit), NULL);
@@ -16,4 +16,6 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 =======================================================================*/
 
-int export_dialog(int *, const gchar *);
+#include <glib.h>
+
+int export_dialog(int *, long int *, long int *, int *, const gchar *);
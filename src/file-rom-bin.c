@@ -24,9 +24,12 @@
 #include <libgimp/gimpui.h>
 
 #include "lib_rom_bin.h"
+#include "rom_format.h"
 #include "read-rom-bin.h"
 #include "write-rom-bin.h"
+#include "rom_patch.h"
 #include "export-dialog.h"
+#include "tile-hashes.h"
 
 const char LOAD_PROCEDURE[] = "file-rom-bin-load";
 const char LOAD_PROCEDURE_NES2BPP_CHRNES[] = "file-bin-bin-load-nes2bpp-chrnes";
@@ -36,11 +39,19 @@ const char SAVE_PROCEDURE[]        = "file-rom-bin-save";
 const char SAVE_PROCEDURE_NES2BPP_CHRNES[] = "file-rom-bin-save-nes2bpp-chrnes";
 const char SAVE_PROCEDURE_GB2BPP_GB[] = "file-rom-bin-save-gb2bpp-gb";
 
+// Export as a patch for the rom file the image was loaded from
+const char SAVE_PROCEDURE_IPS_PATCH[] = "file-rom-bin-save-ips-patch";
+const char SAVE_PROCEDURE_BPS_PATCH[] = "file-rom-bin-save-bps-patch";
+
 const char BINARY_NAME[]    = "file-rom-bin";
 
+// User defined tile formats, read from the GIMP plug-ins folder
+const char USER_FORMATS_FILE[] = "rom-bin-formats.txt";
+
 // Predeclare our entrypoints
 static void query(void);
 static void run(const gchar *, gint, const GimpParam *, gint *, GimpParam **);
+static void load_user_formats(void);
 
 // Declare our plugin entry points
 GimpPlugInInfo PLUG_IN_INFO = {
@@ -60,7 +71,9 @@ static void query(void)
     {
         { GIMP_PDB_INT32,  "run-mode",     "Interactive, non-interactive" },
         { GIMP_PDB_STRING, "filename",     "The name of the file to load" },
-        { GIMP_PDB_STRING, "raw-filename", "The name entered" }
+        { GIMP_PDB_STRING, "raw-filename", "The name entered" },
+        { GIMP_PDB_INT32,  "offset",       "Byte offset of the data to load (0: start of the file)" },
+        { GIMP_PDB_INT32,  "length",       "Number of bytes to load (0: up to the end of the file)" }
     };
 
     // Load return values
@@ -77,7 +90,8 @@ static void query(void)
         { GIMP_PDB_DRAWABLE, "drawable",     "Drawable to save" },
         { GIMP_PDB_STRING,   "filename",     "The name of the file to save the image in" },
         { GIMP_PDB_STRING,   "raw-filename", "The name entered" },
-        { GIMP_PDB_FLOAT,    "image_mode",  "ROM image format" }
+        { GIMP_PDB_FLOAT,    "image_mode",  "ROM image format (user defined formats follow the built-in ones)" },
+        { GIMP_PDB_INT32,    "patch-in-place", "Only write the tiles over the part of the existing file they were loaded from (0: rewrite the whole file)" }
     };
 
     // Install the load procedure for ".bin" files (all formats)
@@ -171,6 +185,35 @@ static void query(void)
                            save_arguments,
                            NULL);
 
+    // Install the save procedures for patches (".ips" and ".bps")
+    gimp_install_procedure(SAVE_PROCEDURE_IPS_PATCH,
+                           "Saves the ROM bin image as an IPS patch of the file it was loaded from",
+                           "Saves the ROM bin image as an IPS patch of the file it was loaded from",
+                           "--",
+                           "Copyright --",
+                           "2018",
+                           "ROM bin image as IPS patch",
+                           "INDEXED*",
+                           GIMP_PLUGIN,
+                           G_N_ELEMENTS(save_arguments),
+                           0,
+                           save_arguments,
+                           NULL);
+
+    gimp_install_procedure(SAVE_PROCEDURE_BPS_PATCH,
+                           "Saves the ROM bin image as a BPS patch of the file it was loaded from",
+                           "Saves the ROM bin image as a BPS patch of the file it was loaded from",
+                           "--",
+                           "Copyright --",
+                           "2018",
+                           "ROM bin image as BPS patch",
+                           "INDEXED*",
+                           GIMP_PLUGIN,
+                           G_N_ELEMENTS(save_arguments),
+                           0,
+                           save_arguments,
+                           NULL);
+
     // Register the load handlers
     gimp_register_load_handler(LOAD_PROCEDURE, "bin", "");
 
@@ -190,6 +233,10 @@ static void query(void)
     // Additional NES handler for ".chr" format files and NES ROM files
     gimp_register_save_handler(SAVE_PROCEDURE_GB2BPP_GB, "gb", "");
 
+    // Patch handlers, for exporting changes to a rom instead of the rom itself
+    gimp_register_save_handler(SAVE_PROCEDURE_IPS_PATCH, "ips", "");
+    gimp_register_save_handler(SAVE_PROCEDURE_BPS_PATCH, "bps", "");
+
     // MIME handler registration is disabled for now, due to non-interactive
     //gimp_register_file_handler_mime(LOAD_PROCEDURE, "image/bin");
     //gimp_register_file_handler_mime(LOAD_PROCEDURE_NES_2BPP, "image/chr");
@@ -197,6 +244,20 @@ static void query(void)
     //gimp_register_file_handler_mime(SAVE_PROCEDURE_NES2BPP_CHRNES, "image/chr");
 }
 
+// Adds the user defined tile formats (if any) to the built-in ones,
+// so they show up in the dialog and can be used by load and save
+static void load_user_formats(void)
+{
+    gchar * p_filename;
+
+    p_filename = g_build_filename(gimp_directory(), "plug-ins", USER_FORMATS_FILE, NULL);
+
+    if (g_file_test(p_filename, G_FILE_TEST_EXISTS))
+        romimg_format_load_file(p_filename);
+
+    g_free(p_filename);
+}
+
 // The run function
 static void run(const gchar * name,
          gint nparams,
@@ -216,6 +277,7 @@ static void run(const gchar * name,
     return_values[0].type          = GIMP_PDB_STATUS;
     return_values[0].data.d_status = GIMP_PDB_SUCCESS;
 
+    load_user_formats();
 
     // Check to see if this is the load procedure
     if( !strcmp(name, LOAD_PROCEDURE) ||
@@ -224,13 +286,26 @@ static void run(const gchar * name,
     {
         int new_image_id;
         int image_mode = -1;
+        long int offset = 0;
+        long int length = 0;
 
         // Check to make sure all parameters were supplied
-        if(nparams != 3) {
+        // (offset and length are optional for callers which predate them)
+        if((nparams != 3) && (nparams != 5)) {
             return_values[0].data.d_status = GIMP_PDB_CALLING_ERROR;
             return;
         }
 
+        if (nparams == 5) {
+            offset = param[3].data.d_int32;
+            length = param[4].data.d_int32;
+
+            if ((offset < 0) || (length < 0)) {
+                return_values[0].data.d_status = GIMP_PDB_CALLING_ERROR;
+                return;
+            }
+        }
+
 
         // Try to export the image
         gimp_ui_init(BINARY_NAME, FALSE);
@@ -253,7 +328,7 @@ static void run(const gchar * name,
             if (GIMP_RUN_INTERACTIVE == run_mode) {
 
                 // Show the import/export dialog
-                if(!export_dialog(&image_mode, name)) {
+                if(!export_dialog(&image_mode, &offset, &length, NULL, name)) {
                     return_values[0].data.d_status = GIMP_PDB_CANCEL;
                     return;
                 }
@@ -267,7 +342,7 @@ static void run(const gchar * name,
 
 
         // Now read the image
-        new_image_id = read_rom_bin(param[1].data.d_string, image_mode);
+        new_image_id = read_rom_bin(param[1].data.d_string, image_mode, offset, length);
 
         // Check for an error
         if(new_image_id == -1)
@@ -284,25 +359,34 @@ static void run(const gchar * name,
     }
     else if(!strcmp(name, SAVE_PROCEDURE) ||
             !strcmp(name, SAVE_PROCEDURE_NES2BPP_CHRNES) ||
-            !strcmp(name, SAVE_PROCEDURE_GB2BPP_GB))
+            !strcmp(name, SAVE_PROCEDURE_GB2BPP_GB) ||
+            !strcmp(name, SAVE_PROCEDURE_IPS_PATCH) ||
+            !strcmp(name, SAVE_PROCEDURE_BPS_PATCH))
     {
         // This is the export procedure
 
-        gint32 image_id, drawable_id;
+        gint32 image_id, drawable_id, orig_image_id;
         int status = 1;
         int image_mode = -1;
+        int patch_in_place = 0;
         GimpExportReturn export_ret;
 
         // Check to make sure all of the parameters were supplied
-        if(nparams != 6)
+        // (patch-in-place is optional for callers which predate it)
+        if((nparams != 6) && (nparams != 7))
         {
             return_values[0].data.d_status = GIMP_PDB_CALLING_ERROR;
             return;
         }
 
+        if (nparams == 7)
+            patch_in_place = param[6].data.d_int32 ? 1 : 0;
+
         image_id    = param[1].data.d_int32;
         drawable_id = param[2].data.d_int32;
 
+        orig_image_id = image_id;
+
         // Try to export the image
         gimp_ui_init(BINARY_NAME, FALSE);
         export_ret = gimp_export_image(&image_id,
@@ -327,15 +411,30 @@ static void run(const gchar * name,
               }
               else {
                 // Now get the settings
-                if(!export_dialog(&image_mode, name))
+                // (patching in place doesn't apply when writing a patch file)
+                if(!export_dialog(&image_mode, NULL, NULL,
+                                  (!strcmp(name, SAVE_PROCEDURE_IPS_PATCH) ||
+                                   !strcmp(name, SAVE_PROCEDURE_BPS_PATCH)) ? NULL : &patch_in_place,
+                                  name))
                 {
                     return_values[0].data.d_status = GIMP_PDB_CANCEL;
                     return;
                 }
               }
 
-                status = write_rom_bin(param[3].data.d_string,
-                                       image_id, drawable_id, image_mode);
+                if (!strcmp(name, SAVE_PROCEDURE_IPS_PATCH))
+                    status = write_rom_patch(param[3].data.d_string,
+                                             image_id, drawable_id, image_mode, ROM_PATCH_IPS);
+                else if (!strcmp(name, SAVE_PROCEDURE_BPS_PATCH))
+                    status = write_rom_patch(param[3].data.d_string,
+                                             image_id, drawable_id, image_mode, ROM_PATCH_BPS);
+                else
+                    status = write_rom_bin(param[3].data.d_string,
+                                           image_id, drawable_id, image_mode, patch_in_place);
+
+                // Keep the hashes of the tiles now in the file with the image
+                // being edited, not just an export copy
+                tile_hashes_copy(image_id, orig_image_id);
                 gimp_image_delete(image_id);
 
                 break;
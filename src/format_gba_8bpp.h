@@ -1,23 +0,0 @@
-/*=======================================================================
-              SNES bin load / save plugin for the GIMP
-                 Copyright 2018 - X
-
-                 Useful : https://www.rpi.edu/dept/acm/packages/gimp/gimp-1.2.3/plug-ins/common/pcx.c
-
- This program is free software: you can redistribute it and/or modify
- it under the terms of the GNU General Public License as published by
- the Free Software Foundation, either version 3 of the License, or
- (at your option) any later version.
-
- This program is distributed in the hope that it will be useful,
- but WITHOUT ANY WARRANTY; without even the implied warranty of
- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- GNU General Public License for more details.
-
- You should have received a copy of the GNU General Public License
- along with this program.  If not, see <http://www.gnu.org/licenses/>.
-=======================================================================*/
-
-
-int bin_decode_gba_8bpp(rom_gfx_data *, app_gfx_data *, app_color_data *);
-int bin_encode_gba_8bpp(rom_gfx_data *, app_gfx_data *);
\ No newline at end of file
@@ -19,67 +19,15 @@
 =======================================================================*/
 
 #include "lib_rom_bin.h"
-
-#include "format_nes_1bpp.h"
-#include "format_nes_2bpp.h"
-#include "format_snesgb_2bpp.h"
-#include "format_ngp_2bpp.h"
-
-#include "format_snes_3bpp.h"
-
-#include "format_gba_4bpp.h"
-#include "format_snespce_4bpp.h"
-#include "format_ggsmswsc_4bpp.h"
-#include "format_gens_4bpp.h"
-
-#include "format_gba_8bpp.h"
-#include "format_snes_8bpp.h"
+#include "rom_format.h"
+#include "rom_utils.h"
+#include "rom_threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <libgimp/gimp.h>
-
-
-
-static int (*function_map_decode[])(rom_gfx_data *,
-                                    app_gfx_data *,
-                                    app_color_data *) =  {
-        [BIN_MODE_NES_1BPP]      = bin_decode_nes_1bpp,
-        [BIN_MODE_NES_2BPP]      = bin_decode_nes_2bpp,
-        [BIN_MODE_SNESGB_2BPP]   = bin_decode_snesgb_2bpp,
-        [BIN_MODE_NGPC_2BPP]     = bin_decode_ngpc_2bpp,
-
-        [BIN_MODE_SNES_3BPP]     = bin_decode_snes_3bpp,
-
-        [BIN_MODE_GBA_4BPP]      = bin_decode_gba_4bpp,
-        [BIN_MODE_SNES_4BPP]     = bin_decode_snes_4bpp,
-        [BIN_MODE_GGSMSWSC_4BPP] = bin_decode_ggsmswsc_4bpp,
-        [BIN_MODE_GENS_4BPP]     = bin_decode_gens_4bpp,
-
-        [BIN_MODE_GBA_8BPP]      = bin_decode_gba_8bpp,
-        [BIN_MODE_SNES_8BPP]     = bin_decode_snes_8bpp,
-};
-
-
-static int (*function_map_encode[])(rom_gfx_data *,
-                                    app_gfx_data *) =  {
-        [BIN_MODE_NES_1BPP]      = bin_encode_nes_1bpp,
-        [BIN_MODE_NES_2BPP]      = bin_encode_nes_2bpp,
-        [BIN_MODE_SNESGB_2BPP]   = bin_encode_snesgb_2bpp,
-        [BIN_MODE_NGPC_2BPP]     = bin_encode_ngpc_2bpp,
-
-        [BIN_MODE_SNES_3BPP]     = bin_encode_snes_3bpp,
-
-        [BIN_MODE_GBA_4BPP]      = bin_encode_gba_4bpp,
-        [BIN_MODE_SNES_4BPP]     = bin_encode_snes_4bpp,
-        [BIN_MODE_GGSMSWSC_4BPP] = bin_encode_ggsmswsc_4bpp,
-        [BIN_MODE_GENS_4BPP]     = bin_encode_gens_4bpp,
-
-        [BIN_MODE_GBA_8BPP]      = bin_encode_gba_8bpp,
-        [BIN_MODE_SNES_8BPP]     = bin_encode_snes_8bpp,
-};
+#include <strings.h>
 
 
 
@@ -91,9 +39,11 @@ void rom_bin_init_structs(rom_gfx_data * p_rom_gfx,
     p_app_gfx->width      = 0;
     p_app_gfx->height     = 0;
     p_app_gfx->p_data     = NULL;
+    p_app_gfx->bytes_per_pixel = BIN_BITDEPTH_INDEXED;
     p_app_gfx->size       = 0;
     p_app_gfx->p_surplus_bytes    = NULL;
     p_app_gfx->surplus_bytes_size = 0;
+    p_app_gfx->empty_tile_count   = 0;
 
 
     p_colorpal->index           = 0;
@@ -108,19 +58,71 @@ void rom_bin_init_structs(rom_gfx_data * p_rom_gfx,
 
 
 
+// Frees the buffers the library allocated in the structs and clears their
+// pointers. Any of the structs can be NULL (see lib_rom_bin.h for which
+// buffers belong to the library)
+void rom_bin_free_structs(rom_gfx_data * p_rom_gfx,
+                          app_gfx_data * p_app_gfx,
+                          app_color_data * p_colorpal)
+{
+    if (NULL != p_rom_gfx) {
+        free(p_rom_gfx->p_data);
+        p_rom_gfx->p_data = NULL;
+    }
+
+    if (NULL != p_app_gfx) {
+        free(p_app_gfx->p_data);
+        free(p_app_gfx->p_surplus_bytes);
+        p_app_gfx->p_data          = NULL;
+        p_app_gfx->p_surplus_bytes = NULL;
+    }
+
+    if (NULL != p_colorpal) {
+        free(p_colorpal->p_data);
+        p_colorpal->p_data = NULL;
+    }
+}
+
+
+
 int rom_bin_decode(rom_gfx_data * p_rom_gfx,
                    app_gfx_data * p_app_gfx,
                    app_color_data * p_colorpal)
 {
-    // Call the matching decode function
-    if (p_app_gfx->image_mode < BIN_MODE_LAST) {
+    const rom_format * p_format;
 
-        if (0 != function_map_decode[ p_app_gfx->image_mode ](p_rom_gfx,
-                                                             p_app_gfx,
-                                                             p_colorpal))
-            return -1;
-    }
-    else
+    // Look up the matching format, then decode with it
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    if (0 != romimg_format_decode(p_format,
+                                  p_rom_gfx,
+                                  p_app_gfx,
+                                  p_colorpal))
+        return -1;
+
+
+    // Return success
+    return 0;
+}
+
+
+// Streaming decode: rom_bin_decode_begin() works out the image size, surplus
+// bytes, empty tile count and color map (p_app_gfx->p_data is left NULL),
+// then rom_bin_decode_rows() decodes whole tile rows into a caller buffer
+int rom_bin_decode_begin(rom_gfx_data * p_rom_gfx,
+                         app_gfx_data * p_app_gfx,
+                         app_color_data * p_colorpal)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    if (0 != romimg_format_decode_begin(p_format,
+                                        p_rom_gfx,
+                                        p_app_gfx,
+                                        p_colorpal))
         return -1;
 
 
@@ -129,20 +131,245 @@ int rom_bin_decode(rom_gfx_data * p_rom_gfx,
 }
 
 
+// Decodes image rows first_row to first_row + row_count - 1 into p_rows
+// (row_count rows of the image width). Both have to be multiples of the
+// tile height, which rom_bin_tile_height() returns
+int rom_bin_decode_rows(rom_gfx_data * p_rom_gfx,
+                        app_gfx_data * p_app_gfx,
+                        int first_row,
+                        int row_count,
+                        unsigned char * p_rows)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    if (0 != romimg_format_decode_rows(p_format,
+                                       p_rom_gfx,
+                                       p_app_gfx,
+                                       first_row,
+                                       row_count,
+                                       p_rows))
+        return -1;
+
+
+    // Return success
+    return 0;
+}
+
+
+// Returns the tile height of an image mode, -1 if the mode is unknown
+int rom_bin_tile_height(int image_mode)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(image_mode)))
+        return -1;
+
+    return (int)p_format->ATTRIB.TILE_PIXEL_HEIGHT;
+}
+
+
 int rom_bin_encode(rom_gfx_data * p_rom_gfx,
                    app_gfx_data * p_app_gfx)
 {
-    // Call the matching encode function
-    if (p_app_gfx->image_mode < BIN_MODE_LAST) {
+    const rom_format * p_format;
+
+    // Look up the matching format, then encode with it
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    if (0 != romimg_format_encode(p_format,
+                                  p_rom_gfx,
+                                  p_app_gfx))
+        return -1;
+
+
+    // Return success
+    return 0;
+}
+
+
+
+// Returns the encoded size of one tile of an image mode, -1 if the mode is unknown
+long int rom_bin_tile_size_bytes(int image_mode)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(image_mode)))
+        return -1;
+
+    return romimg_calc_tile_size_bytes(p_format->ATTRIB);
+}
+
+
+// Returns the encoded size of row_count image rows (whole tile rows), -1 if the mode is unknown
+long int rom_bin_encoded_rows_size(app_gfx_data * p_app_gfx,
+                                   int row_count)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    return (long int)(row_count / p_format->ATTRIB.TILE_PIXEL_HEIGHT)
+                   * (p_app_gfx->width / p_format->ATTRIB.TILE_PIXEL_WIDTH)
+                   * romimg_calc_tile_size_bytes(p_format->ATTRIB);
+}
+
+
+// Streaming encode: encodes image rows first_row to first_row + row_count - 1
+// from p_rows (row_count rows of the image width) to p_rom_data, which needs
+// rom_bin_encoded_rows_size() bytes. Both have to be multiples of the tile height.
+//
+// Empty tiles are added to *p_empty_tile_count. Once all rows are done that
+// many tiles get trimmed off the end of the rom (before any surplus bytes),
+// the same as rom_bin_encode() does
+int rom_bin_encode_rows(app_gfx_data * p_app_gfx,
+                        int first_row,
+                        int row_count,
+                        unsigned char * p_rows,
+                        unsigned char * p_rom_data,
+                        unsigned int  * p_empty_tile_count)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    if (0 != romimg_format_encode_rows(p_format,
+                                       p_app_gfx,
+                                       first_row,
+                                       row_count,
+                                       p_rows,
+                                       p_rom_data,
+                                       p_empty_tile_count))
+        return -1;
+
+
+    // Return success
+    return 0;
+}
+
+
+// Hashes each tile of row_count image rows (a multiple of the tile height)
+// from p_rows into p_hashes, one per tile in the order they get encoded.
+// Comparing them with earlier hashes tells which tiles changed
+int rom_bin_hash_tiles(app_gfx_data * p_app_gfx,
+                       int row_count,
+                       const unsigned char * p_rows,
+                       uint64_t * p_hashes)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(p_app_gfx->image_mode)))
+        return -1;
+
+    if ((row_count % p_format->ATTRIB.TILE_PIXEL_HEIGHT) != 0)
+        return -1;
+
+    romimg_hash_tiles(p_rows, row_count, p_hashes, p_app_gfx, p_format->ATTRIB);
+
+    // Return success
+    return 0;
+}
+
+
+
+// Number of tile formats: the built-in ones (enum rom_bin_modes), then any
+// loaded with rom_bin_format_load_file()
+int rom_bin_format_count(void)
+{
+    return romimg_format_count();
+}
+
+
+// Returns the display name of a format, NULL if there's no such format
+const char * rom_bin_format_name(int image_mode)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(image_mode)))
+        return NULL;
+
+    return p_format->NAME;
+}
+
+
+// Returns the format with the given name (ignoring case), -1 if there's none
+int rom_bin_format_find(const char * p_name)
+{
+    int image_mode;
 
-        if (0 != function_map_encode[ p_app_gfx->image_mode ](p_rom_gfx,
-                                                             p_app_gfx))
-            return -1;
+    for (image_mode = 0; image_mode < romimg_format_count(); image_mode++) {
+        if (0 == strcasecmp(p_name, romimg_format_get(image_mode)->NAME))
+            return image_mode;
     }
-    else
+
+    return -1;
+}
+
+
+// Copies the tile size, bit depth and color count of a format to *p_attrib
+int rom_bin_format_attrib(int image_mode, rom_gfx_attrib * p_attrib)
+{
+    const rom_format * p_format;
+
+    if (NULL == (p_format = romimg_format_get(image_mode)))
         return -1;
 
+    *p_attrib = p_format->ATTRIB;
 
     // Return success
     return 0;
 }
+
+
+// Adds the user defined formats in a formats file (see the README).
+// Returns the number of formats added, -1 if the file can't be read
+int rom_bin_format_load_file(const char * p_filename)
+{
+    return romimg_format_load_file(p_filename);
+}
+
+
+
+// Starts thread_count worker threads (0: one per processor core) for
+// rom_bin_jobs_submit(). The formats must all be loaded by now
+//
+// Returns the number of threads started, or -1 if they couldn't be
+// (the jobs then run right away when they're submitted)
+int rom_bin_jobs_begin(int thread_count)
+{
+    int image_mode;
+
+    // Pick the kernels now rather than from several threads at once
+    for (image_mode = 0; image_mode < romimg_format_count(); image_mode++)
+        romimg_format_prepare(romimg_format_get(image_mode));
+
+    return romimg_sched_start(thread_count);
+}
+
+
+// Queues a job, it may run on any of the worker threads. Jobs which
+// decode / encode with rom_bin_*() share the image bands with idle workers
+void rom_bin_jobs_submit(rom_bin_job_fn p_job_fn, void * p_ctx)
+{
+    romimg_sched_submit(p_job_fn, p_ctx);
+}
+
+
+// Blocks until all submitted jobs have finished
+void rom_bin_jobs_wait(void)
+{
+    romimg_sched_wait();
+}
+
+
+// Waits for the jobs, then stops the worker threads
+void rom_bin_jobs_end(void)
+{
+    romimg_sched_wait();
+    romimg_sched_stop();
+}
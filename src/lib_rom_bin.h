@@ -16,16 +16,48 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 =======================================================================*/
 
-#include <glib.h>
+// Public interface of the tile codec (librombin)
+//
+// Plain C, without GIMP or GLib types, so tools can link the codec
+// directly. The structs and functions below are the library ABI. Callers
+// allocate the structs themselves, so any change to them (even adding a
+// field at the end changes their size) is incompatible and has to bump
+// ROM_BIN_ABI_VERSION, the shared library's so version.
+//
+// Buffer ownership: these are malloc'd by the library, and have to be
+// freed with rom_bin_free_structs() (not free(), the library can have its
+// own heap when it's a DLL):
+//
+//     rom_bin_decode()        app_gfx p_data and p_surplus_bytes, color map p_data
+//     rom_bin_decode_begin()  app_gfx p_surplus_bytes, color map p_data
+//     rom_bin_encode()        rom_gfx p_data
+//
+// Everything else (the rom data being decoded, the image being encoded,
+// row buffers passed in) belongs to the caller. Pass NULL to
+// rom_bin_free_structs() for a struct which only holds caller buffers,
+// or set the pointer to NULL after freeing the caller buffer.
+
+#ifndef ROM_BIN_FILE_HEADER
+#define ROM_BIN_FILE_HEADER
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-//#include <libgimp/gimp.h>
 
+#define ROM_BIN_ABI_VERSION    1
 
-#ifndef ROM_BIN_FILE_HEADER
-#define ROM_BIN_FILE_HEADER
+// Building the shared library exports only the functions marked ROM_BIN_API
+#if defined(ROM_BIN_BUILD_SHARED) && defined(_WIN32)
+    #define ROM_BIN_API    __declspec(dllexport)
+#elif defined(ROM_BIN_BUILD_SHARED) && defined(__GNUC__)
+    #define ROM_BIN_API    __attribute__((visibility("default")))
+#else
+    #define ROM_BIN_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
     // TODO: update naming convention
     enum rom_bin_modes {
@@ -53,8 +85,6 @@
         BIN_BITDEPTH_LAST
     };
 
-    // TODO: move these to lib_rom_bin.h
-
         typedef struct rom_gfx_attrib {
             unsigned int  IMAGE_WIDTH_DEFAULT;
             unsigned int  TILE_PIXEL_WIDTH;
@@ -76,6 +106,10 @@
 
             long int         surplus_bytes_size;
             unsigned char  * p_surplus_bytes;
+
+            // Decode: number of tiles at the end of the image past the end
+            // of the rom data, 0 if every tile has data
+            long int         empty_tile_count;
         }  app_gfx_data;
 
         typedef struct rom_gfx_data {
@@ -90,10 +124,37 @@
             unsigned char * p_data;
         } app_color_data;
 
-    void rom_bin_init_structs(rom_gfx_data *, app_gfx_data *, app_color_data *);
-
-    int rom_bin_decode(rom_gfx_data *, app_gfx_data *, app_color_data *);
-    int rom_bin_encode(rom_gfx_data *, app_gfx_data *);
-
+    ROM_BIN_API void rom_bin_init_structs(rom_gfx_data *, app_gfx_data *, app_color_data *);
+    ROM_BIN_API void rom_bin_free_structs(rom_gfx_data *, app_gfx_data *, app_color_data *);
+
+    ROM_BIN_API int rom_bin_decode(rom_gfx_data *, app_gfx_data *, app_color_data *);
+    ROM_BIN_API int rom_bin_encode(rom_gfx_data *, app_gfx_data *);
+    ROM_BIN_API int rom_bin_decode_begin(rom_gfx_data *, app_gfx_data *, app_color_data *);
+    ROM_BIN_API int rom_bin_decode_rows(rom_gfx_data *, app_gfx_data *, int, int, unsigned char *);
+    ROM_BIN_API int rom_bin_tile_height(int);
+
+    ROM_BIN_API long int rom_bin_tile_size_bytes(int);
+    ROM_BIN_API long int rom_bin_encoded_rows_size(app_gfx_data *, int);
+    ROM_BIN_API int rom_bin_encode_rows(app_gfx_data *, int, int, unsigned char *, unsigned char *, unsigned int *);
+    ROM_BIN_API int rom_bin_hash_tiles(app_gfx_data *, int, const unsigned char *, uint64_t *);
+
+    ROM_BIN_API int rom_bin_format_count(void);
+    ROM_BIN_API const char * rom_bin_format_name(int);
+    ROM_BIN_API int rom_bin_format_find(const char *);
+    ROM_BIN_API int rom_bin_format_attrib(int, rom_gfx_attrib *);
+    ROM_BIN_API int rom_bin_format_load_file(const char *);
+
+    // Batches of jobs (each decoding / encoding whole images) on a pool
+    // of worker threads. Bands of big images get shared out to idle workers
+    typedef void (*rom_bin_job_fn)(void * p_ctx);
+
+    ROM_BIN_API int rom_bin_jobs_begin(int);
+    ROM_BIN_API void rom_bin_jobs_submit(rom_bin_job_fn, void *);
+    ROM_BIN_API void rom_bin_jobs_wait(void);
+    ROM_BIN_API void rom_bin_jobs_end(void);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // ROM_BIN_FILE_HEADER
\ No newline at end of file
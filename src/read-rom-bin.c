@@ -18,23 +18,70 @@
 
 #include "read-rom-bin.h"
 #include "lib_rom_bin.h"
+#include "rom_file.h"
+#include "tile-hashes.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <libgimp/gimp.h>
 
-int read_rom_bin(const gchar * filename, int image_mode)
+// Pixels are decoded and handed to GIMP in strips of this many GIMP tile
+// rows (64 pixels each), so memory use doesn't grow with the rom size
+#define READ_STRIP_GIMP_TILE_ROWS    64
+
+// Records where the loaded part of the file was, how big the file is and the
+// format it was decoded with, so export can rebuild the file around it or
+// patch it back in place. And which file it was, to make patches against
+void file_window_attach(gint32 image_id, const gchar * filename, long int offset, long int length,
+                        long int file_size, int image_mode)
+{
+    GimpParasite * parasite;
+    gchar        * p_window_text;
+
+    p_window_text = g_strdup_printf("%ld %ld %ld %d", offset, length, file_size, image_mode);
+    parasite = gimp_parasite_new("ROM-BIN-WINDOW",
+                                 GIMP_PARASITE_PERSISTENT,
+                                 strlen(p_window_text) + 1,
+                                 p_window_text);
+    gimp_image_attach_parasite(image_id,
+                               parasite);
+    gimp_parasite_free(parasite);
+    g_free(p_window_text);
+
+    parasite = gimp_parasite_new("ROM-BIN-SOURCE-FILE",
+                                 GIMP_PARASITE_PERSISTENT,
+                                 strlen(filename) + 1,
+                                 filename);
+    gimp_image_attach_parasite(image_id,
+                               parasite);
+    gimp_parasite_free(parasite);
+}
+
+
+// Loads length bytes of a rom file starting at offset (length 0: up to the end).
+//
+// The part of the file which was loaded is recorded in a parasite along with
+// the file size, so export can copy the bytes around it back from the file
+int read_rom_bin(const gchar * filename, int image_mode, long int offset, long int length)
 {
     int status = 1;
 
     gint32 new_image_id,
            new_layer_id;
+    GimpImageType layer_type;
+    unsigned char * p_strip;
+    int tile_height, strip_rows, strip_y;
     GimpDrawable * drawable;
     GimpPixelRgn rgn;
     GimpParasite * parasite;
 
-    FILE * file;
+    rom_file_source rom_source;
+    long int        window_length, file_size;
+
+    uint64_t      * p_tile_hashes;
+    long int        tile_count, tiles_per_tile_row;
 
 
     app_gfx_data   app_gfx;
@@ -44,49 +91,44 @@ int read_rom_bin(const gchar * filename, int image_mode)
     rom_bin_init_structs(&rom_gfx, &app_gfx, &colorpal);
 
     app_gfx.image_mode      = image_mode;
-    app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED_ALPHA;
+    // Decode without alpha, it only gets added if some tiles are past the end of the data
+    app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED;
 
 
-    // Try to open the file
-    file = fopen(filename, "rb");
-    if(!file)
+    // Map (or read) the file, only the part being loaded
+    if (0 != romimg_file_load_range(filename, offset, length, &rom_gfx, &rom_source))
         return -1;
 
-    // Get the file size
-    fseek(file, 0, SEEK_END);
-    rom_gfx.size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    // Now prepare a buffer of that size
-    // and read the data.
-    rom_gfx.p_data = malloc(rom_gfx.size);
-    fread(rom_gfx.p_data, rom_gfx.size, 1, file);
+    window_length = rom_gfx.size;
 
-    // Close the file
-    fclose(file);
-
-    // Make sure the alloc succeeded
-    if(rom_gfx.p_data == NULL)
-        return -1;
+    // Only part of a regular file can be loaded, since export has to read the rest back
+    file_size = romimg_file_size(filename);
 
+    if (file_size < 0) {
+        if ((offset > 0) || (length > 0)) {
+            printf("Image load failed: can't load part of %s, it isn't a regular file\n", filename);
+            romimg_file_release(&rom_gfx, &rom_source);
+            return -1;
+        }
+        file_size = window_length;
+    }
 
-    // Perform the load procedure and free the raw data.
-    status = rom_bin_decode(&rom_gfx,
-                            &app_gfx,
-                            &colorpal);
 
-    free(rom_gfx.p_data);
+    // Work out the image size, surplus bytes and color map,
+    // the pixels are decoded a strip at a time further down
+    status = rom_bin_decode_begin(&rom_gfx,
+                                  &app_gfx,
+                                  &colorpal);
 
     // Check to make sure that the load was successful
-    if (0 != status)
+    if ((0 != status) || (0 == app_gfx.width) || (0 == app_gfx.height))
     {
         printf("Image load failed \n");
 
-        if (app_gfx.p_data)
-            free(app_gfx.p_data);
+        romimg_file_release(&rom_gfx, &rom_source);
 
-        if (colorpal.p_data)
-            free(colorpal.p_data);
+        // The rom data is the mapped file, only the rest came from the library
+        rom_bin_free_structs(NULL, &app_gfx, &colorpal);
 
         printf("Image load failed: free complete \n");
 
@@ -94,6 +136,39 @@ int read_rom_bin(const gchar * filename, int image_mode)
     }
 
 
+    // Tiles past the end of the rom data are shown as transparent,
+    // so only those images need an alpha channel
+    if (app_gfx.empty_tile_count > 0) {
+        app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED_ALPHA;
+        layer_type = GIMP_INDEXEDA_IMAGE;
+    }
+    else
+        layer_type = GIMP_INDEXED_IMAGE;
+
+
+    // Strips are a whole number of GIMP tile rows, rounded down to whole rom tile rows
+    tile_height = rom_bin_tile_height(image_mode);
+    strip_rows  = gimp_tile_height() * READ_STRIP_GIMP_TILE_ROWS;
+    strip_rows -= strip_rows % tile_height;
+
+    if (strip_rows < tile_height)
+        strip_rows = tile_height;
+    if (strip_rows > (int)app_gfx.height)
+        strip_rows = app_gfx.height;
+
+    p_strip = malloc((size_t)app_gfx.width * strip_rows * app_gfx.bytes_per_pixel);
+    if (NULL == p_strip) {
+        romimg_file_release(&rom_gfx, &rom_source);
+        rom_bin_free_structs(NULL, &app_gfx, &colorpal);
+        return -1;
+    }
+
+
+    // Hashes of the tiles as loaded, so patching the file back can skip
+    // the ones which didn't change (optional, nothing fails without them)
+    p_tile_hashes      = tile_hashes_alloc(&app_gfx, app_gfx.height, &tile_count);
+    tiles_per_tile_row = (NULL != p_tile_hashes) ? tile_count / (app_gfx.height / tile_height) : 0;
+
 
     // Now create the new INDEXED image.
     new_image_id = gimp_image_new(app_gfx.width, app_gfx.height, GIMP_INDEXED);
@@ -102,7 +177,7 @@ int read_rom_bin(const gchar * filename, int image_mode)
     new_layer_id = gimp_layer_new(new_image_id,
                                   "Background",
                                   app_gfx.width, app_gfx.height,
-                                  GIMP_INDEXEDA_IMAGE,
+                                  layer_type,
                                   100,
                                   GIMP_NORMAL_MODE);
 
@@ -120,11 +195,46 @@ int read_rom_bin(const gchar * filename, int image_mode)
                         app_gfx.width, app_gfx.height,
                         TRUE, FALSE);
 
-    // Now FINALLY set the pixel data
-    gimp_pixel_rgn_set_rect(&rgn,
-                            app_gfx.p_data,
-                            0, 0,
-                            app_gfx.width, app_gfx.height);
+    // Decode a strip, hand it to GIMP, then move on to the next one.
+    // Only one strip of pixels is held outside of GIMP at any time
+    for (strip_y = 0; strip_y < (int)app_gfx.height; strip_y += strip_rows) {
+
+        if (strip_rows > ((int)app_gfx.height - strip_y))
+            strip_rows = app_gfx.height - strip_y;
+
+        if (0 != rom_bin_decode_rows(&rom_gfx,
+                                     &app_gfx,
+                                     strip_y,
+                                     strip_rows,
+                                     p_strip)) {
+            printf("Image load failed at row %d\n", strip_y);
+            status = -1;
+            break;
+        }
+
+        gimp_pixel_rgn_set_rect(&rgn,
+                                p_strip,
+                                0, strip_y,
+                                app_gfx.width, strip_rows);
+
+        if ((NULL != p_tile_hashes) &&
+            (0 != rom_bin_hash_tiles(&app_gfx,
+                                     strip_rows,
+                                     p_strip,
+                                     p_tile_hashes + (strip_y / tile_height) * tiles_per_tile_row))) {
+            free(p_tile_hashes);
+            p_tile_hashes = NULL;
+        }
+    }
+
+    free(p_strip);
+
+    if (NULL != p_tile_hashes) {
+        if (0 == status)
+            tile_hashes_attach(new_image_id, filename, &app_gfx, p_tile_hashes, tile_count);
+        free(p_tile_hashes);
+    }
+    romimg_file_release(&rom_gfx, &rom_source);
 
 
 
@@ -139,25 +249,27 @@ int read_rom_bin(const gchar * filename, int image_mode)
          gimp_image_attach_parasite(new_image_id, 
                                     parasite);
          gimp_parasite_free (parasite);
-
-        // Free the surplus bytes now that they are stored as a parasite
-        free(app_gfx.p_surplus_bytes);
     }
 
 
+    file_window_attach(new_image_id, filename, offset, window_length, file_size, image_mode);
+
+
     // We're done with the drawable
     gimp_drawable_flush(drawable);
     gimp_drawable_detach(drawable);
 
-    // Free the image data
-    free(app_gfx.p_data);
-
-    // Free the color map data
-    free(colorpal.p_data);
+    // Free the color map data and the surplus bytes (stored as a parasite by now)
+    rom_bin_free_structs(NULL, &app_gfx, &colorpal);
 
     // Add the layer to the image
     gimp_image_insert_layer(new_image_id, new_layer_id, -1, 0);
 
+    if (0 != status) {
+        gimp_image_delete(new_image_id);
+        return -1;
+    }
+
     // Set the filename
     gimp_image_set_filename(new_image_id, filename);
 
@@ -18,4 +18,5 @@
 
 #include <glib.h>
 
-int read_rom_bin(const gchar *, int);
+int read_rom_bin(const gchar *, int, long int, long int);
+void file_window_attach(gint32, const gchar *, long int, long int, long int, int);
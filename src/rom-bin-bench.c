@@ -0,0 +1,323 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+// rom-bin-bench: decode / encode speed of every tile format
+//
+// Decodes and encodes a buffer of random rom data with each format through
+// the public librombin interface, and prints the rom data throughput in MB/s.
+// Bitplane formats are also decoded by a copy of the original per-bit decode
+// loop, to show what the lookup table kernels gain over it ("old decode").
+// The tile kernels are picked by the library, ROM_BIN_CPU_LEVEL and
+// ROM_BIN_THREADS change them the same way as for the plugin ("make bench"
+// runs it once per CPU level on a single thread).
+//
+//   rom-bin-bench [rom size in MB] [repeats]
+
+#include "lib_rom_bin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ROM_SIZE_MB_DEFAULT    16
+#define BENCH_REPEATS_DEFAULT        5
+#define BENCH_MB                     (1024L * 1024L)
+
+#define BENCH_TILE_SIZE              8
+#define BENCH_MAX_PLANES             8
+
+
+// Bitplane layouts of the built-in planar formats (as in rom_format.c),
+// for the reference decoder. The library doesn't export its layouts
+typedef struct bench_planar_layout {
+    int image_mode;
+    int bitplanes;
+    int plane_offset[BENCH_MAX_PLANES];
+    int plane_row_increment[BENCH_MAX_PLANES];
+} bench_planar_layout;
+
+static const bench_planar_layout bench_planar_layouts[] = {
+    { BIN_MODE_NES_1BPP,      1, { 0 },                             { 1 } },
+    { BIN_MODE_NES_2BPP,      2, { 0, 8 },                          { 1, 1 } },
+    { BIN_MODE_SNESGB_2BPP,   2, { 0, 1 },                          { 2, 2 } },
+    { BIN_MODE_SNES_3BPP,     3, { 0, 1, 16 },                      { 2, 2, 1 } },
+    { BIN_MODE_SNES_4BPP,     4, { 0, 1, 16, 17 },                  { 2, 2, 2, 2 } },
+    { BIN_MODE_GGSMSWSC_4BPP, 4, { 0, 1, 2, 3 },                    { 4, 4, 4, 4 } },
+    { BIN_MODE_SNES_8BPP,     8, { 0, 1, 16, 17, 32, 33, 48, 49 },  { 2, 2, 2, 2, 2, 2, 2, 2 } },
+};
+
+
+
+static double bench_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+
+
+// Returns the bitplane layout of a built-in planar format, NULL for the others
+static const bench_planar_layout * bench_get_planar_layout(int image_mode)
+{
+    unsigned int i;
+
+    for (i=0; i < (sizeof(bench_planar_layouts) / sizeof(bench_planar_layouts[0])); i++)
+        if (bench_planar_layouts[i].image_mode == image_mode)
+            return &bench_planar_layouts[i];
+
+    return NULL;
+}
+
+
+
+// Reference decoder: the per-bit loop the format decoders used before the
+// tile kernels. Each row of each tile reads one byte per bitplane, then
+// shifts every byte one bit at a time to build the 8 pixels
+static void bench_reference_decode(const bench_planar_layout * p_layout, const unsigned char * p_rom_data,
+                                   long int rom_size, app_gfx_data * p_app_gfx, unsigned char * p_pixels)
+{
+    unsigned char   pixel_val;
+    unsigned char   pixdata[BENCH_MAX_PLANES];
+    unsigned char * p_image_pixel;
+    long int        rom_offset, tile_size_in_bytes;
+    unsigned char   rom_ended;
+
+    int x,y,ty,b,p;
+
+    rom_offset         = 0;
+    rom_ended          = 0;
+    tile_size_in_bytes = p_layout->bitplanes * BENCH_TILE_SIZE;
+
+    for (y=0; y < (int)(p_app_gfx->height / BENCH_TILE_SIZE); y++) {
+        for (x=0; x < (int)(p_app_gfx->width / BENCH_TILE_SIZE); x++) {
+
+            // The tiles past the end of the rom data are transparent
+            if ((rom_offset + tile_size_in_bytes) > rom_size)
+                rom_ended = 1;
+
+            for (ty=0; ty < BENCH_TILE_SIZE; ty++) {
+
+                p_image_pixel = p_pixels + (p_app_gfx->bytes_per_pixel
+                                            * ((((long int)y * BENCH_TILE_SIZE + ty) * p_app_gfx->width)
+                                               + (x * BENCH_TILE_SIZE)));
+
+                for (p=0; p < p_layout->bitplanes; p++)
+                    pixdata[p] = (rom_ended) ? 0 : p_rom_data[rom_offset + p_layout->plane_offset[p]
+                                                              + (ty * p_layout->plane_row_increment[p])];
+
+                // Unpack the 8 horizontal pixels, MS bit is the leftmost pixel
+                for (b=0; b < BENCH_TILE_SIZE; b++) {
+
+                    pixel_val = 0;
+                    for (p=0; p < p_layout->bitplanes; p++) {
+                        pixel_val |= ((pixdata[p] >> 7) & 0x01) << p;
+                        pixdata[p] <<= 1;
+                    }
+
+                    *(p_image_pixel++) = pixel_val;
+                    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel)
+                        *(p_image_pixel++) = (rom_ended) ? 0 : 255;
+                }
+            }
+
+            rom_offset += tile_size_in_bytes;
+        }
+    }
+}
+
+
+
+// Times decoding then encoding rom_size bytes of random data with one format,
+// keeping the best of repeats runs of each. Bitplane formats are decoded by
+// the reference decoder as well (*p_reference_mbs, 0 for the other formats).
+// Returns -1 if the format fails
+static int bench_format(int image_mode, const unsigned char * p_rom_data, long int rom_size, int repeats,
+                        double * p_reference_mbs, double * p_decode_mbs, double * p_encode_mbs)
+{
+    const bench_planar_layout * p_layout;
+
+    rom_gfx_data   rom_gfx;
+    app_gfx_data   app_gfx;
+    app_color_data colorpal;
+
+    unsigned char * p_pixels = NULL;
+    unsigned char * p_encoded = NULL;
+    unsigned char * p_reference = NULL;
+    unsigned int    empty_tile_count;
+    long int        encoded_size;
+    size_t          pixels_size;
+    double          start, seconds, best_reference, best_decode, best_encode;
+    int             repeat;
+    int             status;
+
+    rom_bin_init_structs(&rom_gfx, &app_gfx, &colorpal);
+
+    rom_gfx.p_data     = (unsigned char *)p_rom_data;
+    rom_gfx.size       = rom_size;
+    app_gfx.image_mode = image_mode;
+
+    status = rom_bin_decode_begin(&rom_gfx, &app_gfx, &colorpal);
+
+    if ((0 == status) && (app_gfx.empty_tile_count > 0))
+        app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED_ALPHA;
+
+    encoded_size = (0 == status) ? rom_bin_encoded_rows_size(&app_gfx, app_gfx.height) : 0;
+    pixels_size  = (size_t)app_gfx.width * app_gfx.height * app_gfx.bytes_per_pixel;
+    p_layout     = bench_get_planar_layout(image_mode);
+
+    if ((0 != status) || (encoded_size <= 0) ||
+        (NULL == (p_pixels = malloc(pixels_size))) ||
+        (NULL == (p_encoded = malloc(encoded_size))) ||
+        ((NULL != p_layout) && (NULL == (p_reference = malloc(pixels_size)))))
+        status = -1;
+
+    best_reference = 0;
+    best_decode    = 0;
+    best_encode    = 0;
+
+    for (repeat = 0; (0 == status) && (repeat < repeats); repeat++) {
+
+        if (NULL != p_layout) {
+            start = bench_now();
+            bench_reference_decode(p_layout, p_rom_data, rom_size, &app_gfx, p_reference);
+            seconds = bench_now() - start;
+
+            if ((0 == repeat) || (seconds < best_reference))
+                best_reference = seconds;
+        }
+
+        start = bench_now();
+        if (0 != rom_bin_decode_rows(&rom_gfx, &app_gfx, 0, app_gfx.height, p_pixels))
+            status = -1;
+        seconds = bench_now() - start;
+
+        if ((0 == repeat) || (seconds < best_decode))
+            best_decode = seconds;
+
+        empty_tile_count = 0;
+
+        start = bench_now();
+        if ((0 == status) &&
+            (0 != rom_bin_encode_rows(&app_gfx, 0, app_gfx.height, p_pixels, p_encoded, &empty_tile_count)))
+            status = -1;
+        seconds = bench_now() - start;
+
+        if ((0 == repeat) || (seconds < best_encode))
+            best_encode = seconds;
+    }
+
+    // Both decoders have to give the same pixels
+    if ((0 == status) && (NULL != p_layout) && (0 != memcmp(p_reference, p_pixels, pixels_size))) {
+        printf("%s: decoded pixels don't match the reference decoder\n", rom_bin_format_name(image_mode));
+        status = -1;
+    }
+
+    // Encoding what was decoded has to give back the same tiles
+    encoded_size -= (long int)empty_tile_count * rom_bin_tile_size_bytes(image_mode);
+
+    if ((0 == status) && (0 != memcmp(p_encoded, p_rom_data, encoded_size))) {
+        printf("%s: encoded tiles don't match the rom data\n", rom_bin_format_name(image_mode));
+        status = -1;
+    }
+
+    if (0 == status) {
+        *p_reference_mbs = (NULL != p_layout) ? ((double)rom_size / BENCH_MB) / best_reference : 0;
+        *p_decode_mbs = ((double)rom_size / BENCH_MB) / best_decode;
+        *p_encode_mbs = ((double)rom_size / BENCH_MB) / best_encode;
+    }
+
+    free(p_pixels);
+    free(p_encoded);
+    free(p_reference);
+
+    // The rom data is ours, only the rest came from the library
+    rom_bin_free_structs(NULL, &app_gfx, &colorpal);
+
+    return status;
+}
+
+
+
+int main(int argc, char * argv[])
+{
+    unsigned char * p_rom_data;
+    const char    * p_cpu_level;
+    const char    * p_threads;
+    long int        rom_size, byte;
+    double          reference_mbs, decode_mbs, encode_mbs;
+    int             repeats, image_mode;
+    int             status = 0;
+
+    rom_size = BENCH_ROM_SIZE_MB_DEFAULT;
+    repeats  = BENCH_REPEATS_DEFAULT;
+
+    if (argc > 1)
+        rom_size = atol(argv[1]);
+    if (argc > 2)
+        repeats = atoi(argv[2]);
+
+    if ((rom_size <= 0) || (repeats <= 0)) {
+        printf("usage: rom-bin-bench [rom size in MB] [repeats]\n");
+        return 1;
+    }
+
+    rom_size *= BENCH_MB;
+
+    if (NULL == (p_rom_data = malloc(rom_size))) {
+        printf("Can't allocate %ld MB of rom data\n", rom_size / BENCH_MB);
+        return 1;
+    }
+
+    // Random tiles, so the kernels can't take any shortcuts
+    srand(1);
+    for (byte = 0; byte < rom_size; byte++)
+        p_rom_data[byte] = (unsigned char)(rand() >> 7);
+
+    p_cpu_level = getenv("ROM_BIN_CPU_LEVEL");
+    p_threads   = getenv("ROM_BIN_THREADS");
+
+    printf("CPU level: %s, threads: %s, %ld MB, best of %d\n",
+           p_cpu_level ? p_cpu_level : "auto",
+           p_threads   ? p_threads   : "auto",
+           rom_size / BENCH_MB, repeats);
+    printf("%-20s %16s %12s %8s %12s\n", "format", "old decode MB/s", "decode MB/s", "speedup", "encode MB/s");
+
+    for (image_mode = 0; image_mode < rom_bin_format_count(); image_mode++) {
+
+        if (0 != bench_format(image_mode, p_rom_data, rom_size, repeats, &reference_mbs, &decode_mbs, &encode_mbs)) {
+            printf("%-20s failed\n", rom_bin_format_name(image_mode));
+            status = 1;
+            continue;
+        }
+
+        if (reference_mbs > 0)
+            printf("%-20s %16.1f %12.1f %7.1fx %12.1f\n", rom_bin_format_name(image_mode),
+                   reference_mbs, decode_mbs, decode_mbs / reference_mbs, encode_mbs);
+        else
+            printf("%-20s %16s %12.1f %8s %12.1f\n", rom_bin_format_name(image_mode),
+                   "n/a", decode_mbs, "n/a", encode_mbs);
+    }
+
+    free(p_rom_data);
+
+    return status;
+}
@@ -0,0 +1,1025 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+// rom-bin: command line converter between rom tile data and images
+//
+// Uses the same codec as the GIMP plugin (lib_rom_bin and the format files)
+// without GIMP, for converting assets in bulk from build scripts.
+//
+//   rom-bin decode [options] <rom file> <image.png | image.raw>
+//   rom-bin encode [options] <image.png | image.raw> <rom file>
+//   rom-bin formats [--formats-file <file>]
+//   rom-bin decode | encode --batch [options] <directory | list file> <output directory>
+//
+// PNG images are 8 bit indexed. Tiles past the end of the rom data are
+// written with a fully transparent color (as the plugin shows them) and
+// are dropped again on encode. Bytes after the last whole tile are kept
+// in a private "rbSp" chunk, so decoding then encoding gives back the
+// same file. Raw images are one byte (the color index) per pixel.
+//
+// Batches convert every file of a directory, or the files named in a list,
+// on the library's worker threads (rom_bin_jobs_*), biggest files first.
+
+#include "lib_rom_bin.h"
+#include "rom_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <png.h>
+
+// Private PNG chunk holding the surplus (non tile) bytes at the end of the rom data
+#define CLI_PNG_SURPLUS_CHUNK    "rbSp"
+
+enum cli_image_types {
+    CLI_IMAGE_PNG,
+    CLI_IMAGE_RAW
+};
+
+typedef struct cli_options {
+    int          image_mode;
+    unsigned int width;            // 0: format default
+    long int     offset;
+    long int     length;           // 0: to the end of the file
+    int          has_offset;
+    const char * p_palette_file;
+    int          image_type;
+} cli_options;
+
+// One file of a batch
+typedef struct cli_batch_job {
+    struct cli_batch * p_batch;
+    int                index;          // in the order the jobs get started
+    char             * p_input;
+    char             * p_output;
+    long int           size;           // of the input file
+    int                status;
+} cli_batch_job;
+
+typedef struct cli_batch {
+    cli_options   * p_options;
+    int             is_decode;
+    const char    * p_output_dir;
+    cli_batch_job * p_jobs;
+    int             job_count;
+    int             job_capacity;
+    int             prefetch_ahead;    // how many jobs ahead to prefetch the input of
+} cli_batch;
+
+
+
+static void cli_usage(void)
+{
+    printf("Usage:\n"
+           "  rom-bin decode [options] <rom file> <image.png | image.raw>\n"
+           "  rom-bin encode [options] <image.png | image.raw> <rom file>\n"
+           "  rom-bin formats [--formats-file <file>]\n"
+           "  rom-bin decode | encode --batch [options] <directory | list file> <output directory>\n"
+           "\n"
+           "Options:\n"
+           "  -f, --format <name | number>  tile format (see rom-bin formats), default 0\n"
+           "  -w, --width <pixels>          decode: image width, a multiple of the tile width (default 128)\n"
+           "                                encode: width of a raw image (required for raw)\n"
+           "  -o, --offset <bytes>          decode: start of the data in the rom file\n"
+           "                                encode: write the tiles into the existing rom file at this\n"
+           "                                offset, leaving the rest of it as it is\n"
+           "  -l, --length <bytes>          decode: number of bytes to decode (default: to the end)\n"
+           "  -p, --palette <file>          decode: PNG colors, JASC-PAL or raw RGB triplets\n"
+           "  -r, --raw                     image is raw indexes (also picked for a .raw file name)\n"
+           "      --formats-file <file>     add the user defined tile formats in <file>\n"
+           "  -b, --batch                   convert all files in a directory, or listed in a file\n"
+           "                                (one per line: input, optionally a tab and the output name)\n"
+           "  -j, --jobs <threads>          batch: worker threads (default: one per processor core)\n"
+           "\n"
+           "Numbers can be hex with 0x.\n");
+}
+
+
+
+// Parses a non negative number (decimal, or hex with 0x), -1 if it isn't one
+static long int cli_parse_number(const char * p_text)
+{
+    char * p_end;
+    long int value;
+
+    value = strtol(p_text, &p_end, 0);
+
+    if ((p_end == p_text) || (*p_end != '\0') || (value < 0))
+        return -1;
+
+    return value;
+}
+
+
+
+// Finds a format by number or (case insensitive) name, -1 if there's no match
+static int cli_find_format(const char * p_text)
+{
+    long int number;
+
+    number = cli_parse_number(p_text);
+    if ((number >= 0) && (number < rom_bin_format_count()))
+        return (int)number;
+
+    return rom_bin_format_find(p_text);
+}
+
+
+
+// Replaces the first colors of the color map with the ones from a palette
+// file: JASC-PAL text (as written by most tile editors), or raw RGB triplets
+static int cli_load_palette(const char * p_filename, app_color_data * p_colorpal)
+{
+    FILE * file;
+    char   line[256];
+    int    r, g, b, count, index;
+    unsigned char rgb[3];
+
+    if (NULL == (file = fopen(p_filename, "rb"))) {
+        printf("Can't open palette %s\n", p_filename);
+        return -1;
+    }
+
+    index = 0;
+
+    if ((NULL != fgets(line, sizeof(line), file)) && (0 == strncmp(line, "JASC-PAL", 8))) {
+
+        // Version line, then the number of colors, then one "r g b" line per color
+        if ((NULL == fgets(line, sizeof(line), file)) ||
+            (NULL == fgets(line, sizeof(line), file)) ||
+            (1 != sscanf(line, "%d", &count))) {
+            printf("Invalid JASC-PAL palette %s\n", p_filename);
+            fclose(file);
+            return -1;
+        }
+
+        while ((index < count) && (index < p_colorpal->size) &&
+               (NULL != fgets(line, sizeof(line), file)) &&
+               (3 == sscanf(line, "%d %d %d", &r, &g, &b))) {
+            p_colorpal->p_data[(index * 3) + 0] = (unsigned char)r;
+            p_colorpal->p_data[(index * 3) + 1] = (unsigned char)g;
+            p_colorpal->p_data[(index * 3) + 2] = (unsigned char)b;
+            index++;
+        }
+    }
+    else {
+        rewind(file);
+
+        while ((index < p_colorpal->size) && (1 == fread(rgb, sizeof(rgb), 1, file))) {
+            memcpy(p_colorpal->p_data + (index * 3), rgb, sizeof(rgb));
+            index++;
+        }
+    }
+
+    fclose(file);
+
+    if (0 == index) {
+        printf("No colors in palette %s\n", p_filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+static int cli_write_raw(const char * p_filename, app_gfx_data * p_app_gfx)
+{
+    FILE * file;
+    long int pixel, pixel_count;
+    int status = 0;
+
+    if (NULL == (file = fopen(p_filename, "wb")))
+        return -1;
+
+    pixel_count = (long int)p_app_gfx->width * p_app_gfx->height;
+
+    // Only the color index of each pixel (tiles past the end of the data are 0)
+    if (BIN_BITDEPTH_INDEXED == p_app_gfx->bytes_per_pixel) {
+        if (1 != fwrite(p_app_gfx->p_data, pixel_count, 1, file))
+            status = -1;
+    }
+    else {
+        for (pixel = 0; (0 == status) && (pixel < pixel_count); pixel++) {
+            if (EOF == fputc(p_app_gfx->p_data[pixel * 2 + 1] ? p_app_gfx->p_data[pixel * 2] : 0, file))
+                status = -1;
+        }
+    }
+
+    if (0 != fclose(file))
+        status = -1;
+
+    return status;
+}
+
+
+
+static int cli_write_png(const char * p_filename, app_gfx_data * p_app_gfx, app_color_data * p_colorpal)
+{
+    FILE        * file;
+    png_structp   png;
+    png_infop     info;
+    png_color     palette[256];
+    png_byte      trans[256];
+    png_unknown_chunk surplus_chunk;
+    unsigned char * p_row = NULL;
+    int color_count, transparent_index, n;
+    unsigned int x, y;
+
+    if (NULL == (p_row = malloc(p_app_gfx->width)))
+        return -1;
+
+    if (NULL == (file = fopen(p_filename, "wb"))) {
+        free(p_row);
+        return -1;
+    }
+
+    png  = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+
+    if ((NULL == info) || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        free(p_row);
+        fclose(file);
+        return -1;
+    }
+
+    png_init_io(png, file);
+
+    color_count = p_colorpal->size;
+    for (n = 0; n < color_count; n++) {
+        palette[n].red   = p_colorpal->p_data[(n * 3) + 0];
+        palette[n].green = p_colorpal->p_data[(n * 3) + 1];
+        palette[n].blue  = p_colorpal->p_data[(n * 3) + 2];
+    }
+
+    // Tiles past the end of the rom data get an extra, fully transparent color.
+    // A 256 color format has no room for it, they're left as color 0 then
+    transparent_index = -1;
+
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+        if (color_count < 256) {
+            transparent_index = color_count;
+
+            palette[color_count].red = palette[color_count].green = palette[color_count].blue = 0;
+            color_count++;
+
+            memset(trans, 0xFF, sizeof(trans));
+            trans[transparent_index] = 0;
+        }
+        else
+            printf("Warning: %s has no spare color for the tiles past the end of the data,"
+                   " they will be encoded back as tiles\n", p_filename);
+    }
+
+    png_set_IHDR(png, info, p_app_gfx->width, p_app_gfx->height, 8,
+                 PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_PLTE(png, info, palette, color_count);
+
+    if (transparent_index >= 0)
+        png_set_tRNS(png, info, trans, transparent_index + 1, NULL);
+
+    if (p_app_gfx->surplus_bytes_size > 0) {
+        memset(&surplus_chunk, 0, sizeof(surplus_chunk));
+        memcpy(surplus_chunk.name, CLI_PNG_SURPLUS_CHUNK, 5);
+        surplus_chunk.data     = p_app_gfx->p_surplus_bytes;
+        surplus_chunk.size     = p_app_gfx->surplus_bytes_size;
+        surplus_chunk.location = PNG_HAVE_PLTE;
+
+        png_set_keep_unknown_chunks(png, PNG_HANDLE_CHUNK_ALWAYS, (png_const_bytep)CLI_PNG_SURPLUS_CHUNK, 1);
+        png_set_unknown_chunks(png, info, &surplus_chunk, 1);
+    }
+
+    png_write_info(png, info);
+
+    for (y = 0; y < p_app_gfx->height; y++) {
+
+        if (BIN_BITDEPTH_INDEXED == p_app_gfx->bytes_per_pixel)
+            png_write_row(png, p_app_gfx->p_data + ((size_t)y * p_app_gfx->width));
+        else {
+            const unsigned char * p_pixel = p_app_gfx->p_data + ((size_t)y * p_app_gfx->width * 2);
+
+            for (x = 0; x < p_app_gfx->width; x++, p_pixel += 2)
+                p_row[x] = ((0 == p_pixel[1]) && (transparent_index >= 0)) ? (unsigned char)transparent_index : p_pixel[0];
+
+            png_write_row(png, p_row);
+        }
+    }
+
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    free(p_row);
+
+    return (0 == fclose(file)) ? 0 : -1;
+}
+
+
+
+static int cli_decode(const char * p_rom_filename, const char * p_image_filename, cli_options * p_options)
+{
+    rom_gfx_data    rom_gfx;
+    app_gfx_data    app_gfx;
+    app_color_data  colorpal;
+    rom_file_source source;
+    int status;
+
+    rom_bin_init_structs(&rom_gfx, &app_gfx, &colorpal);
+
+    app_gfx.image_mode      = p_options->image_mode;
+    app_gfx.width           = p_options->width;
+    app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED;
+
+    if (0 != romimg_file_load_range(p_rom_filename, p_options->offset, p_options->length, &rom_gfx, &source)) {
+        printf("Can't read %s\n", p_rom_filename);
+        return -1;
+    }
+
+    status = rom_bin_decode_begin(&rom_gfx, &app_gfx, &colorpal);
+
+    if ((0 == status) && ((0 == app_gfx.width) || (0 == app_gfx.height))) {
+        printf("%s: not enough data for a single tile\n", p_rom_filename);
+        status = -1;
+    }
+
+    // Same as the plugin, only images with tiles past the end of the data need alpha
+    if ((0 == status) && (app_gfx.empty_tile_count > 0))
+        app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED_ALPHA;
+
+    if ((0 == status) &&
+        (NULL == (app_gfx.p_data = malloc((size_t)app_gfx.width * app_gfx.height * app_gfx.bytes_per_pixel))))
+        status = -1;
+
+    if (0 == status)
+        status = rom_bin_decode_rows(&rom_gfx, &app_gfx, 0, app_gfx.height, app_gfx.p_data);
+
+    romimg_file_release(&rom_gfx, &source);
+
+    if ((0 == status) && (NULL != p_options->p_palette_file))
+        status = cli_load_palette(p_options->p_palette_file, &colorpal);
+
+    if (0 == status) {
+        if (CLI_IMAGE_RAW == p_options->image_type) {
+            status = cli_write_raw(p_image_filename, &app_gfx);
+            printf("%s: %u x %u\n", p_image_filename, app_gfx.width, app_gfx.height);
+
+            if (app_gfx.surplus_bytes_size > 0)
+                printf("Warning: the last %ld bytes of %s aren't a whole tile, raw images don't keep them\n",
+                       app_gfx.surplus_bytes_size, p_rom_filename);
+        }
+        else
+            status = cli_write_png(p_image_filename, &app_gfx, &colorpal);
+
+        if (0 != status)
+            printf("Can't write %s\n", p_image_filename);
+    }
+
+    // The pixels are in our own buffer, the rest came from the library
+    free(app_gfx.p_data);
+    app_gfx.p_data = NULL;
+
+    rom_bin_free_structs(NULL, &app_gfx, &colorpal);
+
+    return status;
+}
+
+
+
+static int cli_read_raw(const char * p_filename, app_gfx_data * p_app_gfx)
+{
+    rom_gfx_data    raw;
+    rom_file_source source;
+    int tile_height;
+
+    if (0 == p_app_gfx->width) {
+        printf("Raw images need their width (--width)\n");
+        return -1;
+    }
+
+    if (0 != romimg_file_load(p_filename, &raw, &source))
+        return -1;
+
+    // Only whole rows of tiles
+    tile_height        = rom_bin_tile_height(p_app_gfx->image_mode);
+    p_app_gfx->height  = (unsigned int)(raw.size / p_app_gfx->width);
+    p_app_gfx->height -= p_app_gfx->height % tile_height;
+    p_app_gfx->bytes_per_pixel = BIN_BITDEPTH_INDEXED;
+
+    if ((0 == p_app_gfx->height) ||
+        (NULL == (p_app_gfx->p_data = malloc((size_t)p_app_gfx->width * p_app_gfx->height)))) {
+        romimg_file_release(&raw, &source);
+        return -1;
+    }
+
+    memcpy(p_app_gfx->p_data, raw.p_data, (size_t)p_app_gfx->width * p_app_gfx->height);
+    romimg_file_release(&raw, &source);
+
+    return 0;
+}
+
+
+
+static int cli_read_png(const char * p_filename, app_gfx_data * p_app_gfx)
+{
+    FILE        * file;
+    png_structp   png;
+    png_infop     info;
+    png_bytep     p_trans = NULL;
+    png_unknown_chunkp p_chunks;
+    png_bytep * volatile pp_rows = NULL;
+    unsigned char * volatile p_pixels = NULL;
+    size_t row_size;
+    int trans_count = 0, chunk_count, color_type, n;
+    unsigned int x, y;
+    int has_transparency;
+
+    if (NULL == (file = fopen(p_filename, "rb")))
+        return -1;
+
+    png  = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+
+    if ((NULL == info) || setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        free(pp_rows);
+        free(p_pixels);
+        free(p_app_gfx->p_data);
+        p_app_gfx->p_data = NULL;
+        fclose(file);
+        return -1;
+    }
+
+    png_init_io(png, file);
+    png_set_keep_unknown_chunks(png, PNG_HANDLE_CHUNK_ALWAYS, (png_const_bytep)CLI_PNG_SURPLUS_CHUNK, 1);
+    png_read_info(png, info);
+
+    color_type = png_get_color_type(png, info);
+
+    // The pixel values are the color indexes, so only indexed or gray images will do
+    if (((PNG_COLOR_TYPE_PALETTE != color_type) && (PNG_COLOR_TYPE_GRAY != color_type)) ||
+        (png_get_bit_depth(png, info) > 8)) {
+        printf("%s: needs to be an indexed (or 8 bit gray) PNG\n", p_filename);
+        png_destroy_read_struct(&png, &info, NULL);
+        fclose(file);
+        return -1;
+    }
+
+    // One byte per pixel, without scaling the values up
+    png_set_packing(png);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    if (PNG_COLOR_TYPE_PALETTE == color_type)
+        png_get_tRNS(png, info, &p_trans, &trans_count, NULL);
+
+    p_app_gfx->width  = png_get_image_width(png, info);
+    p_app_gfx->height = png_get_image_height(png, info);
+
+    // Pixels with a fully transparent color mark tiles without data, which don't get encoded
+    has_transparency = 0;
+    for (n = 0; n < trans_count; n++) {
+        if (0 == p_trans[n])
+            has_transparency = 1;
+    }
+
+    p_app_gfx->bytes_per_pixel = has_transparency ? BIN_BITDEPTH_INDEXED_ALPHA : BIN_BITDEPTH_INDEXED;
+
+    row_size = png_get_rowbytes(png, info);
+
+    if ((NULL == (p_app_gfx->p_data = malloc((size_t)p_app_gfx->width * p_app_gfx->height * p_app_gfx->bytes_per_pixel))) ||
+        (NULL == (p_pixels = malloc(row_size * p_app_gfx->height))) ||
+        (NULL == (pp_rows  = malloc(sizeof(png_bytep) * p_app_gfx->height))))
+        png_error(png, "out of memory");
+
+    for (y = 0; y < p_app_gfx->height; y++)
+        pp_rows[y] = p_pixels + (y * row_size);
+
+    png_read_image(png, pp_rows);
+
+    for (y = 0; y < p_app_gfx->height; y++) {
+        const unsigned char * p_src = pp_rows[y];
+        unsigned char * p_dest = p_app_gfx->p_data + ((size_t)y * p_app_gfx->width * p_app_gfx->bytes_per_pixel);
+
+        for (x = 0; x < p_app_gfx->width; x++) {
+            if (has_transparency) {
+                *p_dest++ = p_src[x];
+                *p_dest++ = ((p_src[x] < trans_count) && (0 == p_trans[p_src[x]])) ? 0x00 : 0xFF;
+            }
+            else
+                *p_dest++ = p_src[x];
+        }
+    }
+
+    png_read_end(png, info);
+
+    // Surplus bytes from decoding, to go back after the tiles
+    chunk_count = png_get_unknown_chunks(png, info, &p_chunks);
+    for (n = 0; n < chunk_count; n++) {
+        if ((0 == memcmp(p_chunks[n].name, CLI_PNG_SURPLUS_CHUNK, 4)) && (p_chunks[n].size > 0) &&
+            (NULL != (p_app_gfx->p_surplus_bytes = malloc(p_chunks[n].size)))) {
+            memcpy(p_app_gfx->p_surplus_bytes, p_chunks[n].data, p_chunks[n].size);
+            p_app_gfx->surplus_bytes_size = p_chunks[n].size;
+            break;
+        }
+    }
+
+    png_destroy_read_struct(&png, &info, NULL);
+    free(pp_rows);
+    free(p_pixels);
+    fclose(file);
+
+    return 0;
+}
+
+
+
+static int cli_encode(const char * p_image_filename, const char * p_rom_filename, cli_options * p_options)
+{
+    FILE * file;
+    rom_gfx_data    rom_gfx;
+    app_gfx_data    app_gfx;
+    app_color_data  colorpal;
+    rom_gfx_attrib  attrib;
+    long int pixel, pixel_count;
+    int status;
+
+    rom_bin_init_structs(&rom_gfx, &app_gfx, &colorpal);
+
+    rom_bin_format_attrib(p_options->image_mode, &attrib);
+    app_gfx.image_mode = p_options->image_mode;
+    app_gfx.width      = p_options->width;
+
+    if (CLI_IMAGE_RAW == p_options->image_type)
+        status = cli_read_raw(p_image_filename, &app_gfx);
+    else
+        status = cli_read_png(p_image_filename, &app_gfx);
+
+    if (0 != status) {
+        printf("Can't read %s\n", p_image_filename);
+        return -1;
+    }
+
+    // Only whole tiles can be encoded, and only with colors the format has
+    if ((0 != (app_gfx.width  % attrib.TILE_PIXEL_WIDTH)) ||
+        (0 != (app_gfx.height % attrib.TILE_PIXEL_HEIGHT))) {
+        printf("%s: %u x %u isn't a whole number of %u x %u tiles\n", p_image_filename,
+               app_gfx.width, app_gfx.height, attrib.TILE_PIXEL_WIDTH, attrib.TILE_PIXEL_HEIGHT);
+        status = -1;
+    }
+
+    pixel_count = (long int)app_gfx.width * app_gfx.height;
+
+    for (pixel = 0; (0 == status) && (pixel < pixel_count); pixel++) {
+
+        // Transparent pixels aren't encoded
+        if ((BIN_BITDEPTH_INDEXED_ALPHA == app_gfx.bytes_per_pixel) && (0 == app_gfx.p_data[pixel * 2 + 1]))
+            continue;
+
+        if (app_gfx.p_data[pixel * app_gfx.bytes_per_pixel] >= attrib.DECODED_NUM_COLORS) {
+            printf("%s: uses color %d, %s only has %u colors\n", p_image_filename,
+                   app_gfx.p_data[pixel * app_gfx.bytes_per_pixel], rom_bin_format_name(p_options->image_mode), attrib.DECODED_NUM_COLORS);
+            status = -1;
+        }
+    }
+
+    if (0 == status)
+        status = rom_bin_encode(&rom_gfx, &app_gfx);
+
+    // Write a new rom file, or the tiles into an existing one
+    if (0 == status) {
+
+        if (p_options->has_offset)
+            file = fopen(p_rom_filename, "r+b");
+        else
+            file = fopen(p_rom_filename, "wb");
+
+        if ((NULL == file) ||
+            (0 != fseek(file, p_options->offset, SEEK_SET)) ||
+            ((rom_gfx.size > 0) && (1 != fwrite(rom_gfx.p_data, rom_gfx.size, 1, file))))
+            status = -1;
+
+        if ((NULL != file) && (0 != fclose(file)))
+            status = -1;
+
+        if (0 != status)
+            printf("Can't write %s\n", p_rom_filename);
+    }
+
+    // Only the encoded rom data came from the library
+    rom_bin_free_structs(&rom_gfx, NULL, NULL);
+
+    free(app_gfx.p_data);
+    free(app_gfx.p_surplus_bytes);
+
+    return status;
+}
+
+
+
+// Image type of a file name: raw for .raw (or with --raw), PNG otherwise
+static int cli_image_type(const char * p_filename, int is_raw)
+{
+    const char * p_dot = strrchr(p_filename, '.');
+
+    if (is_raw || ((NULL != p_dot) && (0 == strcasecmp(p_dot, ".raw"))))
+        return CLI_IMAGE_RAW;
+
+    return CLI_IMAGE_PNG;
+}
+
+
+
+// Adds a file to a batch. Without an output name one is made from the
+// input's: game.sfc decodes to game.sfc.png and that encodes back to game.sfc
+static int cli_batch_add(cli_batch * p_batch, const char * p_input, const char * p_output)
+{
+    cli_batch_job * p_job;
+    struct stat     input_stat;
+    const char    * p_name;
+    const char    * p_dot;
+    const char    * p_extension;
+    int             name_length;
+
+    if ((0 != stat(p_input, &input_stat)) || !S_ISREG(input_stat.st_mode)) {
+        printf("Skipping %s: not a file\n", p_input);
+        return 0;
+    }
+
+    if (p_batch->job_count == p_batch->job_capacity) {
+        p_job = realloc(p_batch->p_jobs, (p_batch->job_capacity + 256) * sizeof(cli_batch_job));
+        if (NULL == p_job)
+            return -1;
+
+        p_batch->p_jobs        = p_job;
+        p_batch->job_capacity += 256;
+    }
+
+    p_job = &p_batch->p_jobs[p_batch->job_count];
+
+    p_extension = "";
+
+    if (NULL != p_output)
+        name_length = (int)strlen(p_output);
+    else {
+        p_name = strrchr(p_input, '/');
+        p_output    = (NULL != p_name) ? (p_name + 1) : p_input;
+        name_length = (int)strlen(p_output);
+        p_dot       = strrchr(p_output, '.');
+
+        if (p_batch->is_decode)
+            p_extension = (CLI_IMAGE_RAW == p_batch->p_options->image_type) ? ".raw" : ".png";
+        else if ((NULL != p_dot) && (p_dot != p_output) &&
+                 ((0 == strcasecmp(p_dot, ".png")) || (0 == strcasecmp(p_dot, ".raw"))))
+            name_length = (int)(p_dot - p_output);
+        else
+            p_extension = ".bin";
+    }
+
+    // Output names are in the output directory
+    p_job->p_output = malloc(strlen(p_batch->p_output_dir) + 1 + name_length + strlen(p_extension) + 1);
+    p_job->p_input  = malloc(strlen(p_input) + 1);
+
+    if ((NULL == p_job->p_output) || (NULL == p_job->p_input)) {
+        free(p_job->p_output);
+        free(p_job->p_input);
+        return -1;
+    }
+
+    strcpy(p_job->p_input, p_input);
+    sprintf(p_job->p_output, "%s/%.*s%s", p_batch->p_output_dir, name_length, p_output, p_extension);
+
+    p_job->p_batch = p_batch;
+    p_job->size    = (long int)input_stat.st_size;
+    p_job->status  = 0;
+    p_batch->job_count++;
+
+    return 0;
+}
+
+
+
+// Adds every file in a directory (apart from hidden ones) to a batch
+static int cli_batch_read_dir(cli_batch * p_batch, const char * p_dirname)
+{
+    DIR           * p_dir;
+    struct dirent * p_entry;
+    char          * p_path;
+    int status = 0;
+
+    if (NULL == (p_dir = opendir(p_dirname)))
+        return -1;
+
+    while ((0 == status) && (NULL != (p_entry = readdir(p_dir)))) {
+
+        if ('.' == p_entry->d_name[0])
+            continue;
+
+        if (NULL == (p_path = malloc(strlen(p_dirname) + 1 + strlen(p_entry->d_name) + 1))) {
+            status = -1;
+            break;
+        }
+
+        sprintf(p_path, "%s/%s", p_dirname, p_entry->d_name);
+        status = cli_batch_add(p_batch, p_path, NULL);
+        free(p_path);
+    }
+
+    closedir(p_dir);
+    return status;
+}
+
+
+
+// Adds the files listed in a text file to a batch: one per line, optionally
+// followed by a tab and the output name. Empty lines and # comments are skipped
+static int cli_batch_read_list(cli_batch * p_batch, const char * p_filename)
+{
+    FILE * file;
+    char   line[4096];
+    char * p_output;
+    int    status = 0;
+
+    if (NULL == (file = fopen(p_filename, "r")))
+        return -1;
+
+    while ((0 == status) && (NULL != fgets(line, sizeof(line), file))) {
+
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (('\0' == line[0]) || ('#' == line[0]))
+            continue;
+
+        if (NULL != (p_output = strchr(line, '\t')))
+            *p_output++ = '\0';
+
+        status = cli_batch_add(p_batch, line, ((NULL != p_output) && ('\0' != *p_output)) ? p_output : NULL);
+    }
+
+    fclose(file);
+    return status;
+}
+
+
+
+// Biggest files first, so a huge one doesn't start last and hold up the end of the batch
+static int cli_batch_job_compare(const void * p_a, const void * p_b)
+{
+    const cli_batch_job * p_job_a = (const cli_batch_job *)p_a;
+    const cli_batch_job * p_job_b = (const cli_batch_job *)p_b;
+
+    if (p_job_a->size != p_job_b->size)
+        return (p_job_a->size < p_job_b->size) ? 1 : -1;
+
+    return strcmp(p_job_a->p_input, p_job_b->p_input);
+}
+
+
+
+static void cli_batch_job_run(void * p_ctx)
+{
+    cli_batch_job * p_job   = (cli_batch_job *)p_ctx;
+    cli_batch     * p_batch = p_job->p_batch;
+    cli_batch_job * p_next;
+    cli_options     options;
+
+    // Get the input of a job further down the list on its way from the disk
+    // while this one converts, by the time a worker gets to it it's in memory
+    if (p_job->index + p_batch->prefetch_ahead < p_batch->job_count) {
+        p_next = &p_batch->p_jobs[p_job->index + p_batch->prefetch_ahead];
+
+        if (p_batch->is_decode)
+            romimg_file_prefetch(p_next->p_input, p_batch->p_options->offset, p_batch->p_options->length);
+        else
+            romimg_file_prefetch(p_next->p_input, 0, 0);
+    }
+
+    options = *p_batch->p_options;
+
+    if (p_batch->is_decode)
+        p_job->status = cli_decode(p_job->p_input, p_job->p_output, &options);
+    else {
+        options.image_type = cli_image_type(p_job->p_input, CLI_IMAGE_RAW == options.image_type);
+        p_job->status = cli_encode(p_job->p_input, p_job->p_output, &options);
+    }
+
+    if (0 != p_job->status)
+        printf("Failed: %s\n", p_job->p_input);
+}
+
+
+
+// Decodes / encodes all the files in a directory or list file into the output directory
+static int cli_batch_run(const char * p_input, const char * p_output_dir, int is_decode, int thread_count, cli_options * p_options)
+{
+    cli_batch   batch;
+    struct stat file_stat;
+    int job, worker_count, failed;
+    int status;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.p_options    = p_options;
+    batch.is_decode    = is_decode;
+    batch.p_output_dir = p_output_dir;
+
+    if ((0 != stat(p_output_dir, &file_stat)) || !S_ISDIR(file_stat.st_mode)) {
+        printf("%s: not a directory\n", p_output_dir);
+        return -1;
+    }
+
+    if ((0 == stat(p_input, &file_stat)) && S_ISDIR(file_stat.st_mode))
+        status = cli_batch_read_dir(&batch, p_input);
+    else
+        status = cli_batch_read_list(&batch, p_input);
+
+    if (0 != status) {
+        printf("Can't read %s\n", p_input);
+    }
+    else if (batch.job_count > 0) {
+
+        qsort(batch.p_jobs, batch.job_count, sizeof(cli_batch_job), cli_batch_job_compare);
+        for (job = 0; job < batch.job_count; job++)
+            batch.p_jobs[job].index = job;
+
+        // Without worker threads the jobs just run one after another
+        worker_count = rom_bin_jobs_begin(thread_count);
+        batch.prefetch_ahead = (worker_count > 0) ? worker_count : 1;
+
+        for (job = 0; job < batch.job_count; job++)
+            rom_bin_jobs_submit(cli_batch_job_run, &batch.p_jobs[job]);
+
+        rom_bin_jobs_end();
+
+        failed = 0;
+        for (job = 0; job < batch.job_count; job++) {
+            if (0 != batch.p_jobs[job].status)
+                failed++;
+        }
+
+        printf("%d of %d files converted\n", batch.job_count - failed, batch.job_count);
+
+        if (failed > 0)
+            status = -1;
+    }
+
+    for (job = 0; job < batch.job_count; job++) {
+        free(batch.p_jobs[job].p_input);
+        free(batch.p_jobs[job].p_output);
+    }
+    free(batch.p_jobs);
+
+    return status;
+}
+
+
+
+int main(int argc, char * argv[])
+{
+    cli_options options;
+    rom_gfx_attrib attrib;
+    const char * p_command;
+    const char * p_files[2];
+    const char * p_format_name = NULL;
+    const char * p_image_filename;
+    int file_count = 0;
+    int is_raw = 0;
+    int is_batch = 0;
+    int thread_count = 0;
+    long int number;
+    int arg, mode;
+
+    if (argc < 2) {
+        cli_usage();
+        return 1;
+    }
+
+    p_command = argv[1];
+
+    memset(&options, 0, sizeof(options));
+
+    for (arg = 2; arg < argc; arg++) {
+
+        const char * p_arg   = argv[arg];
+        const char * p_value = (arg + 1 < argc) ? argv[arg + 1] : NULL;
+
+        if (!strcmp(p_arg, "-r") || !strcmp(p_arg, "--raw")) {
+            is_raw = 1;
+            continue;
+        }
+
+        if (!strcmp(p_arg, "-b") || !strcmp(p_arg, "--batch")) {
+            is_batch = 1;
+            continue;
+        }
+
+        if ((p_arg[0] != '-') || (p_arg[1] == '\0')) {
+            if (file_count >= 2) {
+                cli_usage();
+                return 1;
+            }
+            p_files[file_count++] = p_arg;
+            continue;
+        }
+
+        // Everything else takes a value
+        if (NULL == p_value) {
+            printf("%s needs a value\n", p_arg);
+            return 1;
+        }
+        arg++;
+
+        if (!strcmp(p_arg, "-f") || !strcmp(p_arg, "--format"))
+            p_format_name = p_value;
+        else if (!strcmp(p_arg, "-p") || !strcmp(p_arg, "--palette"))
+            options.p_palette_file = p_value;
+        else if (!strcmp(p_arg, "--formats-file")) {
+            if (rom_bin_format_load_file(p_value) < 0) {
+                printf("Can't read formats file %s\n", p_value);
+                return 1;
+            }
+        }
+        else if (!strcmp(p_arg, "-w") || !strcmp(p_arg, "--width") ||
+                 !strcmp(p_arg, "-o") || !strcmp(p_arg, "--offset") ||
+                 !strcmp(p_arg, "-l") || !strcmp(p_arg, "--length") ||
+                 !strcmp(p_arg, "-j") || !strcmp(p_arg, "--jobs")) {
+
+            if (0 > (number = cli_parse_number(p_value))) {
+                printf("Invalid number for %s: %s\n", p_arg, p_value);
+                return 1;
+            }
+
+            if (p_arg[1] == 'w' || !strcmp(p_arg, "--width"))
+                options.width = (unsigned int)number;
+            else if (p_arg[1] == 'o' || !strcmp(p_arg, "--offset")) {
+                options.offset     = number;
+                options.has_offset = 1;
+            }
+            else if (p_arg[1] == 'l' || !strcmp(p_arg, "--length"))
+                options.length = number;
+            else
+                thread_count = (int)number;
+        }
+        else {
+            printf("Unknown option %s\n", p_arg);
+            cli_usage();
+            return 1;
+        }
+    }
+
+
+    if (!strcmp(p_command, "formats")) {
+        for (mode = 0; mode < rom_bin_format_count(); mode++)
+            printf("%2d  %s\n", mode, rom_bin_format_name(mode));
+        return 0;
+    }
+
+    if ((strcmp(p_command, "decode") && strcmp(p_command, "encode")) || (file_count != 2)) {
+        cli_usage();
+        return 1;
+    }
+
+    // Formats can come from --formats-file, so look it up once all options are read
+    options.image_mode = 0;
+    if ((NULL != p_format_name) && (0 > (options.image_mode = cli_find_format(p_format_name)))) {
+        printf("Unknown format %s (see rom-bin formats)\n", p_format_name);
+        return 1;
+    }
+
+    rom_bin_format_attrib(options.image_mode, &attrib);
+
+    if ((0 != options.width) && (0 != (options.width % attrib.TILE_PIXEL_WIDTH))) {
+        printf("Width has to be a multiple of the tile width (%u)\n", attrib.TILE_PIXEL_WIDTH);
+        return 1;
+    }
+
+    // Batch image types go by each file name (or --raw)
+    if (is_batch) {
+        options.image_type = is_raw ? CLI_IMAGE_RAW : CLI_IMAGE_PNG;
+        return (0 == cli_batch_run(p_files[0], p_files[1], !strcmp(p_command, "decode"), thread_count, &options)) ? 0 : 1;
+    }
+
+    p_image_filename   = !strcmp(p_command, "decode") ? p_files[1] : p_files[0];
+    options.image_type = cli_image_type(p_image_filename, is_raw);
+
+    if (!strcmp(p_command, "decode"))
+        return (0 == cli_decode(p_files[0], p_files[1], &options)) ? 0 : 1;
+    else
+        return (0 == cli_encode(p_files[0], p_files[1], &options)) ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+// Runtime selection of codec implementations
+//
+// The CPU level is worked out once per process: the best level the CPU
+// supports, optionally lowered with the ROM_BIN_CPU_LEVEL environment
+// variable. Each codec then picks (once) the best implementation at or
+// below that level which passes its self-check against the scalar code.
+
+#include "lib_rom_bin.h"
+#include "rom_dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+
+static const char * romimg_cpu_level_names[ROMIMG_CPU_LEVEL_COUNT] = {
+        [ROMIMG_CPU_LEVEL_SCALAR] = "scalar",
+        [ROMIMG_CPU_LEVEL_SWAR]   = "swar",
+        [ROMIMG_CPU_LEVEL_BMI2]   = "bmi2",
+        [ROMIMG_CPU_LEVEL_SSE2]   = "sse2",
+        [ROMIMG_CPU_LEVEL_AVX2]   = "avx2",
+        [ROMIMG_CPU_LEVEL_GFNI]   = "gfni",
+};
+
+static int cpu_level = -1;
+
+
+
+const char * romimg_cpu_level_name(int level)
+{
+    if ((level < 0) || (level >= ROMIMG_CPU_LEVEL_COUNT))
+        return "unknown";
+
+    return romimg_cpu_level_names[level];
+}
+
+
+
+// Returns 1 if the running CPU can execute code for the given level
+int romimg_cpu_level_supported(int level)
+{
+#ifdef ROM_DISPATCH_X86
+    __builtin_cpu_init();
+#endif
+
+    switch (level) {
+        case ROMIMG_CPU_LEVEL_SCALAR:
+        case ROMIMG_CPU_LEVEL_SWAR:
+            return 1;
+
+#ifdef ROM_DISPATCH_X86
+        // PDEP / PEXT are microcoded and very slow on AMD before Zen 3,
+        // the SWAR / SIMD kernels are faster there
+        case ROMIMG_CPU_LEVEL_BMI2:
+            return (__builtin_cpu_supports("bmi2") &&
+                    __builtin_cpu_supports("popcnt") &&
+                    !__builtin_cpu_is("amdfam15h") &&
+                    !__builtin_cpu_is("amdfam17h"));
+
+        case ROMIMG_CPU_LEVEL_SSE2:
+            return (__builtin_cpu_supports("sse2") != 0);
+
+        case ROMIMG_CPU_LEVEL_AVX2:
+            return (__builtin_cpu_supports("avx2") != 0);
+
+        // The GFNI kernels use the 512 bit forms of the affine transform and byte permutes
+        case ROMIMG_CPU_LEVEL_GFNI:
+            return (__builtin_cpu_supports("gfni") &&
+                    __builtin_cpu_supports("avx512bw") &&
+                    __builtin_cpu_supports("avx512vbmi"));
+#endif
+
+        default:
+            return 0;
+    }
+}
+
+
+
+// Parse a level name ("avx2") or number ("3"), returns -1 if not recognized
+static int cpu_level_parse(const char * p_str)
+{
+    char * p_end;
+    long int level;
+    int c;
+
+    for (c=0; c < ROMIMG_CPU_LEVEL_COUNT; c++)
+        if (0 == strcasecmp(p_str, romimg_cpu_level_names[c]))
+            return c;
+
+    level = strtol(p_str, &p_end, 10);
+    if ((p_end != p_str) && (*p_end == '\0') &&
+        (level >= 0) && (level < ROMIMG_CPU_LEVEL_COUNT))
+        return (int)level;
+
+    return -1;
+}
+
+
+
+// Returns the highest codec level to use in this process
+int romimg_cpu_level_get(void)
+{
+    const char * p_env;
+    int forced_level;
+
+    if (cpu_level >= 0)
+        return cpu_level;
+
+    // Start with the best level the CPU supports
+    cpu_level = ROMIMG_CPU_LEVEL_COUNT - 1;
+    while (!romimg_cpu_level_supported(cpu_level))
+        cpu_level--;
+
+    // Allow overriding it from the environment (for testing and benchmarking)
+    p_env = getenv(ROMIMG_CPU_LEVEL_ENV_VAR);
+    if ((p_env != NULL) && (*p_env != '\0')) {
+
+        forced_level = cpu_level_parse(p_env);
+
+        if (forced_level < 0)
+            printf("%s: unknown level \"%s\", using %s\n", ROMIMG_CPU_LEVEL_ENV_VAR,
+                   p_env, romimg_cpu_level_name(cpu_level));
+        else if (forced_level > cpu_level)
+            printf("%s: %s not supported by this CPU, using %s\n", ROMIMG_CPU_LEVEL_ENV_VAR,
+                   romimg_cpu_level_name(forced_level), romimg_cpu_level_name(cpu_level));
+        else
+            cpu_level = forced_level;
+    }
+
+    return cpu_level;
+}
+
+
+
+// Returns the highest level (at most romimg_cpu_level_get()) which passes p_check
+//
+// The scalar level is the reference implementation and is always accepted
+int romimg_dispatch_select_level(romimg_dispatch_check_fn p_check, const void * p_ctx)
+{
+    int level;
+
+    for (level = romimg_cpu_level_get(); level > ROMIMG_CPU_LEVEL_SCALAR; level--) {
+
+        if (p_check(level, p_ctx))
+            return level;
+    }
+
+    return ROMIMG_CPU_LEVEL_SCALAR;
+}
+
+
+
+// Fixed pseudo-random test data for the kernel self-checks
+void romimg_dispatch_fill_test_pattern(unsigned char * p_buf, int size, uint32_t seed)
+{
+    int c;
+
+    for (c=0; c < size; c++) {
+        seed = (seed * 1103515245) + 12345;
+        p_buf[c] = (unsigned char)(seed >> 16);
+    }
+}
@@ -0,0 +1,61 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_DISPATCH_FILE_HEADER
+#define ROM_DISPATCH_FILE_HEADER
+
+#include <stdint.h>
+
+// x86 SIMD kernels are built with per-function target attributes
+// and picked at runtime, so no special compiler flags are needed
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define ROM_DISPATCH_X86
+#endif
+
+// Set this in the environment to force a codec level (by name or number,
+// see romimg_cpu_level_names). Levels the CPU can't run are clamped down
+#define ROMIMG_CPU_LEVEL_ENV_VAR    "ROM_BIN_CPU_LEVEL"
+
+    // Codec implementation levels, from slowest to fastest
+    enum romimg_cpu_levels {
+        ROMIMG_CPU_LEVEL_SCALAR,
+        ROMIMG_CPU_LEVEL_SWAR,    // portable 64 bit "SIMD within a register"
+        ROMIMG_CPU_LEVEL_BMI2,    // PDEP / PEXT bit field scatter / gather
+        ROMIMG_CPU_LEVEL_SSE2,
+        ROMIMG_CPU_LEVEL_AVX2,
+        ROMIMG_CPU_LEVEL_GFNI,    // GFNI + AVX-512 (BW, VBMI)
+
+        ROMIMG_CPU_LEVEL_COUNT
+    };
+
+
+    // Called for each candidate level, from the highest allowed one down.
+    // Should return TRUE if there is an implementation for that level and
+    // it produces the same output as the scalar reference
+    typedef int (*romimg_dispatch_check_fn)(int, const void *);
+
+    int          romimg_cpu_level_get(void);
+    int          romimg_cpu_level_supported(int);
+    const char * romimg_cpu_level_name(int);
+
+    int romimg_dispatch_select_level(romimg_dispatch_check_fn, const void *);
+
+    void romimg_dispatch_fill_test_pattern(unsigned char *, int, uint32_t);
+
+#endif // ROM_DISPATCH_FILE_HEADER
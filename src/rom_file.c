@@ -0,0 +1,295 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+// Rom file input
+//
+// Regular files are memory mapped read-only, so the decoder reads the
+// page cache directly instead of a private copy of the whole file.
+// Pipes, special files and platforms without mmap fall back to reading
+// the file into a buffer.
+
+#include "rom_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #define ROM_FILE_MMAP
+#endif
+
+#define ROM_FILE_READ_CHUNK    (64 * 1024)
+
+
+
+// Reads a stream into a malloc'd buffer, growing it as needed (the size
+// of a pipe isn't known up front). Stops after max_size bytes if it isn't 0
+static int file_read_stream(FILE * p_file, long int max_size, rom_gfx_data * p_rom_gfx)
+{
+    unsigned char * p_data = NULL;
+    unsigned char * p_new_data;
+    size_t          capacity = 0;
+    size_t          size = 0;
+    size_t          read_size;
+
+    do {
+        if ((capacity - size) < ROM_FILE_READ_CHUNK) {
+
+            capacity = (capacity == 0) ? (ROM_FILE_READ_CHUNK * 4) : (capacity * 2);
+
+            if (NULL == (p_new_data = realloc(p_data, capacity)) ) {
+                free(p_data);
+                return -1;
+            }
+            p_data = p_new_data;
+        }
+
+        read_size = capacity - size;
+        if ((max_size > 0) && (read_size > ((size_t)max_size - size)))
+            read_size = (size_t)max_size - size;
+
+        read_size = fread(p_data + size, 1, read_size, p_file);
+        size += read_size;
+
+    } while ((read_size > 0) && ((max_size == 0) || (size < (size_t)max_size)));
+
+    if (ferror(p_file)) {
+        free(p_data);
+        return -1;
+    }
+
+    p_rom_gfx->p_data = p_data;
+    p_rom_gfx->size   = (long int)size;
+
+    // Return success
+    return 0;
+}
+
+
+
+#ifdef ROM_FILE_MMAP
+// Maps length bytes at offset of a regular file read-only (length 0: up to
+// the end of the file), returns -1 if it can't be (or shouldn't be) mapped
+static int file_map(const char * p_filename, long int offset, long int length, rom_gfx_data * p_rom_gfx, rom_file_source * p_source)
+{
+    struct stat file_stat;
+    void      * p_map;
+    long int    map_offset;
+    size_t      map_size;
+    int         fd;
+
+    if (-1 == (fd = open(p_filename, O_RDONLY)))
+        return -1;
+
+    // Only regular files can be mapped
+    if ((0 != fstat(fd, &file_stat)) || !S_ISREG(file_stat.st_mode) ||
+        (offset >= file_stat.st_size)) {
+        close(fd);
+        return -1;
+    }
+
+    if ((0 == length) || (length > (file_stat.st_size - offset)))
+        length = file_stat.st_size - offset;
+
+    // Mappings have to start on a page boundary
+    map_offset = offset - (offset % sysconf(_SC_PAGESIZE));
+    map_size   = (size_t)(length + (offset - map_offset));
+
+    p_map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+
+    // The mapping stays valid after the file is closed
+    close(fd);
+
+    if (MAP_FAILED == p_map)
+        return -1;
+
+    // The decoder reads the file front to back once
+    madvise(p_map, map_size, MADV_SEQUENTIAL);
+
+    #ifdef MADV_HUGEPAGE
+        if (map_size >= ROM_FILE_HUGEPAGE_MIN)
+            madvise(p_map, map_size, MADV_HUGEPAGE);
+    #endif
+
+    p_rom_gfx->p_data = (unsigned char *)p_map + (offset - map_offset);
+    p_rom_gfx->size   = length;
+
+    p_source->is_mapped   = 1;
+    p_source->p_map       = p_map;
+    p_source->mapped_size = map_size;
+
+    // Return success
+    return 0;
+}
+#endif
+
+
+
+// Loads a rom file into p_rom_gfx for decoding. The data is read-only and
+// has to be released with romimg_file_release()
+int romimg_file_load(const char * p_filename, rom_gfx_data * p_rom_gfx, rom_file_source * p_source)
+{
+    return romimg_file_load_range(p_filename, 0, 0, p_rom_gfx, p_source);
+}
+
+
+
+// Same as romimg_file_load(), for length bytes of the file starting at
+// offset. A length of 0 (or past the end of the file) loads up to the end
+//
+// Returns -1 if the file can't be read or offset is past its end
+int romimg_file_load_range(const char * p_filename, long int offset, long int length, rom_gfx_data * p_rom_gfx, rom_file_source * p_source)
+{
+    p_rom_gfx->p_data = NULL;
+    p_rom_gfx->size   = 0;
+
+    p_source->is_mapped   = 0;
+    p_source->p_map       = NULL;
+    p_source->mapped_size = 0;
+
+    if ((offset < 0) || (length < 0))
+        return -1;
+
+    #ifdef ROM_FILE_MMAP
+        if (0 == file_map(p_filename, offset, length, p_rom_gfx, p_source))
+            return 0;
+    #endif
+
+    // Fall back to reading it into a buffer
+    return romimg_file_read_range(p_filename, offset, length, p_rom_gfx);
+}
+
+
+
+// Same as romimg_file_load_range(), but always reads the bytes into a
+// malloc'd buffer (free() it), so they stay valid if the file gets
+// rewritten or truncated afterwards
+int romimg_file_read_range(const char * p_filename, long int offset, long int length, rom_gfx_data * p_rom_gfx)
+{
+    FILE   * p_file;
+    long int skip;
+    int      status;
+
+    p_rom_gfx->p_data = NULL;
+    p_rom_gfx->size   = 0;
+
+    if ((offset < 0) || (length < 0))
+        return -1;
+
+    if (NULL == (p_file = fopen(p_filename, "rb")))
+        return -1;
+
+    // Skip to the start of the range, by reading it if the file can't seek
+    if ((offset > 0) && (0 != fseek(p_file, offset, SEEK_SET))) {
+        for (skip = offset; (skip > 0) && (EOF != fgetc(p_file)); skip--)
+            ;
+    }
+
+    status = file_read_stream(p_file, length, p_rom_gfx);
+
+    fclose(p_file);
+
+    if (0 != status)
+        return -1;
+
+    // An offset past the end of the file leaves nothing to load
+    if ((offset > 0) && (0 == p_rom_gfx->size)) {
+        free(p_rom_gfx->p_data);
+        p_rom_gfx->p_data = NULL;
+        return -1;
+    }
+
+    // Return success
+    return 0;
+}
+
+
+
+// Returns the size of a file in bytes, -1 if it can't be
+// found out (missing files, pipes and special files)
+long int romimg_file_size(const char * p_filename)
+{
+    #ifdef ROM_FILE_MMAP
+        struct stat file_stat;
+
+        if ((0 != stat(p_filename, &file_stat)) || !S_ISREG(file_stat.st_mode))
+            return -1;
+
+        return (long int)file_stat.st_size;
+    #else
+        FILE   * p_file;
+        long int size = -1;
+
+        if (NULL == (p_file = fopen(p_filename, "rb")))
+            return -1;
+
+        if (0 == fseek(p_file, 0, SEEK_END))
+            size = ftell(p_file);
+
+        fclose(p_file);
+
+        return size;
+    #endif
+}
+
+
+
+void romimg_file_release(rom_gfx_data * p_rom_gfx, rom_file_source * p_source)
+{
+    if (NULL == p_rom_gfx->p_data)
+        return;
+
+    #ifdef ROM_FILE_MMAP
+        if (p_source->is_mapped)
+            munmap(p_source->p_map, p_source->mapped_size);
+        else
+            free(p_rom_gfx->p_data);
+    #else
+        free(p_rom_gfx->p_data);
+    #endif
+
+    p_rom_gfx->p_data = NULL;
+    p_rom_gfx->size   = 0;
+    p_source->is_mapped = 0;
+}
+
+
+
+// Asks the OS to start reading length bytes of a file from offset (0:
+// to the end) into the page cache, without waiting for it. Loading it
+// a little later then doesn't have to wait for the disk
+void romimg_file_prefetch(const char * p_filename, long int offset, long int length)
+{
+    #if defined(ROM_FILE_MMAP) && defined(POSIX_FADV_WILLNEED)
+        int fd;
+
+        if ((offset < 0) || (length < 0))
+            return;
+
+        if (0 > (fd = open(p_filename, O_RDONLY)))
+            return;
+
+        posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+        close(fd);
+    #endif
+}
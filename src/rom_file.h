@@ -0,0 +1,42 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_FILE_FILE_HEADER
+#define ROM_FILE_FILE_HEADER
+
+#include "lib_rom_bin.h"
+
+// Files at least this big also get a transparent huge page hint when mapped
+#define ROM_FILE_HUGEPAGE_MIN    (2 * 1024 * 1024)
+
+    // How the data of a loaded rom file is held, so it can be released the same way
+    typedef struct rom_file_source {
+        int    is_mapped;      // TRUE: p_data is inside a read-only memory mapping of the file
+        void * p_map;          // start of the mapping (page aligned, can be before p_data)
+        size_t mapped_size;
+    } rom_file_source;
+
+    int romimg_file_load(const char *, rom_gfx_data *, rom_file_source *);
+    int romimg_file_load_range(const char *, long int, long int, rom_gfx_data *, rom_file_source *);
+    int romimg_file_read_range(const char *, long int, long int, rom_gfx_data *);
+    long int romimg_file_size(const char *);
+    void romimg_file_release(rom_gfx_data *, rom_file_source *);
+    void romimg_file_prefetch(const char *, long int, long int);
+
+#endif // ROM_FILE_FILE_HEADER
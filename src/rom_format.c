@@ -0,0 +1,1084 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#include "rom_format.h"
+#include "rom_utils.h"
+#include "rom_portable.h"
+#include "rom_threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Generic tile codec
+//
+// All formats share the same image loop (romimg_format_decode / encode),
+// the only thing which differs between them is the descriptor (rom_format)
+// and the tile kernels its layout selects (see rom_planar.c / rom_packed.c).
+//
+// The built-in formats below each get their own constant-layout build of the
+// portable tile kernels, so the compiler sees the bitplane offsets / pixel
+// positions as constants. Adding a format only takes a layout and a table entry.
+//
+// Bitplane notation from https://mrclick.zophar.net/TilEd/download/consolegfx.txt
+//
+//      [rC: bpD]: row number C (0-7 in a 8x8 tile), bitplane number D (starting at 1).
+//
+//      [pA-B rC: bp*]: pixels A-B (leftmost pixel is 0), row number C, all bitplanes
+//           of each pixel stored next to each other (linear format).
+
+
+// Images default to 128 pixels wide, with 8x8 pixel tiles,
+// a color for every pixel value and 3 bytes per color: R,G,B
+#define BUILTIN_ATTRIB(bpp) { 128, ROM_PLANAR_TILE_WIDTH, ROM_PLANAR_TILE_HEIGHT, (bpp), (1U << (bpp)), 3 }
+
+
+// Declares the layout "<name>_layout" of a built-in bitplane format, along with
+// SWAR tile kernels built for that exact layout (see rom_portable.h)
+#define BUILTIN_PLANAR_LAYOUT(name, ...)                                                                         \
+    static const rom_planar_layout name##_const_layout = { __VA_ARGS__ };                                       \
+                                                                                                                \
+    static void name##_decode_tile(const unsigned char * p_tile, const rom_planar_layout * p_layout,            \
+                                   unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)                     \
+    {                                                                                                           \
+        (void)p_layout;                                                                                         \
+        planar_swar_decode_tile(p_tile, &name##_const_layout, p_image_pixel, p_app_gfx);                        \
+    }                                                                                                           \
+                                                                                                                \
+    static unsigned int name##_encode_tile(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, \
+                                           unsigned char * p_tile, app_gfx_data * p_app_gfx)                    \
+    {                                                                                                           \
+        (void)p_layout;                                                                                         \
+        return planar_swar_encode_tile(p_image_pixel, &name##_const_layout, p_tile, p_app_gfx);                 \
+    }                                                                                                           \
+                                                                                                                \
+    static rom_planar_layout name##_layout = { __VA_ARGS__,                                                     \
+                                               .PORTABLE_DECODE_TILE = name##_decode_tile,                      \
+                                               .PORTABLE_ENCODE_TILE = name##_encode_tile }
+
+
+// Same as above for a built-in packed (linear) format, with scalar tile kernels
+#define BUILTIN_PACKED_LAYOUT(name, ...)                                                                         \
+    static const rom_packed_layout name##_const_layout = { __VA_ARGS__ };                                       \
+                                                                                                                \
+    static void name##_decode_tile(const unsigned char * p_tile, const rom_packed_layout * p_layout,            \
+                                   unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)                     \
+    {                                                                                                           \
+        (void)p_layout;                                                                                         \
+        packed_scalar_decode_tile(p_tile, &name##_const_layout, p_image_pixel, p_app_gfx);                      \
+    }                                                                                                           \
+                                                                                                                \
+    static unsigned int name##_encode_tile(const unsigned char * p_image_pixel, const rom_packed_layout * p_layout, \
+                                           unsigned char * p_tile, app_gfx_data * p_app_gfx)                    \
+    {                                                                                                           \
+        (void)p_layout;                                                                                         \
+        return packed_scalar_encode_tile(p_image_pixel, &name##_const_layout, p_tile, p_app_gfx);               \
+    }                                                                                                           \
+                                                                                                                \
+    static rom_packed_layout name##_layout = { __VA_ARGS__,                                                     \
+                                               .PORTABLE_DECODE_TILE = name##_decode_tile,                      \
+                                               .PORTABLE_ENCODE_TILE = name##_encode_tile }
+
+
+
+// 1bpp NES / Monochrome, 8 bytes per tile
+//   [r0, bp1], [r1, bp1], [r2, bp1], [r3, bp1], [r4, bp1], [r5, bp1], [r6, bp1], [r7, bp1]
+BUILTIN_PLANAR_LAYOUT(nes_1bpp,
+    .BITPLANES           = 1,
+    .PLANE_OFFSET        = { 0 },
+    .PLANE_ROW_INCREMENT = { 1 });
+
+// 2bpp NES, 16 bytes per tile: bitplane 1 for all rows, then bitplane 2
+//   [r0, bp1], [r1, bp1], [r2, bp1], [r3, bp1], [r4, bp1], [r5, bp1], [r6, bp1], [r7, bp1]
+//   [r0, bp2], [r1, bp2], [r2, bp2], [r3, bp2], [r4, bp2], [r5, bp2], [r6, bp2], [r7, bp2]
+BUILTIN_PLANAR_LAYOUT(nes_2bpp,
+    .BITPLANES           = 2,
+    .PLANE_OFFSET        = { 0, 8 },
+    .PLANE_ROW_INCREMENT = { 1, 1 });
+
+// 2bpp SNES / Game Boy, 16 bytes per tile: bitplanes 1 & 2 intertwined row by row
+//   [r0, bp1], [r0, bp2], [r1, bp1], [r1, bp2], [r2, bp1], [r2, bp2], [r3, bp1], [r3, bp2]
+//   [r4, bp1], [r4, bp2], [r5, bp1], [r5, bp2], [r6, bp1], [r6, bp2], [r7, bp1], [r7, bp2]
+BUILTIN_PLANAR_LAYOUT(snesgb_2bpp,
+    .BITPLANES           = 2,
+    .PLANE_OFFSET        = { 0, 1 },
+    .PLANE_ROW_INCREMENT = { 2, 2 });
+
+// 2bpp Neo Geo Pocket Color, 16 bytes per tile: 4 pixels per byte, MS bits first,
+// each row a little-endian 16 bit value (the second byte holds the leftmost pixels)
+//   [p4-7 r0: bp*], [p0-3 r0: bp*], [p4-7 r1: bp*], [p0-3 r1: bp*], ...
+BUILTIN_PACKED_LAYOUT(ngpc_2bpp,
+    .BITS_PER_PIXEL = 2,
+    .MS_PIXEL_FIRST = 1,
+    .BYTES_REVERSED = 1);
+
+// 3bpp SNES, 24 bytes per tile: bitplanes 1 & 2 intertwined row by row,
+// then bitplane 3 stored one byte per row
+//   [r0, bp1], [r0, bp2], [r1, bp1], [r1, bp2], ... [r7, bp1], [r7, bp2]
+//   [r0, bp3], [r1, bp3], [r2, bp3], [r3, bp3], [r4, bp3], [r5, bp3], [r6, bp3], [r7, bp3]
+BUILTIN_PLANAR_LAYOUT(snes_3bpp,
+    .BITPLANES           = 3,
+    .PLANE_OFFSET        = { 0, 1, 16 },
+    .PLANE_ROW_INCREMENT = { 2, 2, 1 });
+
+// 4bpp GBA, 32 bytes per tile: 2 pixels per byte, LS bits first
+//   [p0-1 r0: bp*], [p2-3 r0: bp*], [p4-5 r0: bp*], [p6-7 r0: bp*], ...
+BUILTIN_PACKED_LAYOUT(gba_4bpp,
+    .BITS_PER_PIXEL = 4,
+    .MS_PIXEL_FIRST = 0,
+    .BYTES_REVERSED = 0);
+
+// 4bpp SNES / PC Engine, 32 bytes per tile: bitplanes 1 & 2 intertwined
+// row by row, then bitplanes 3 & 4 the same way
+//   [r0, bp1], [r0, bp2], [r1, bp1], [r1, bp2], ... [r7, bp1], [r7, bp2]
+//   [r0, bp3], [r0, bp4], [r1, bp3], [r1, bp4], ... [r7, bp3], [r7, bp4]
+BUILTIN_PLANAR_LAYOUT(snespce_4bpp,
+    .BITPLANES           = 4,
+    .PLANE_OFFSET        = { 0, 1, 16, 17 },
+    .PLANE_ROW_INCREMENT = { 2, 2, 2, 2 });
+
+// 4bpp Game Gear / Sega Master System / Wonderswan Color, 32 bytes per tile:
+// all 4 bitplanes of a row next to each other
+//   [r0, bp1], [r0, bp2], [r0, bp3], [r0, bp4], [r1, bp1], [r1, bp2], [r1, bp3], [r1, bp4], ...
+BUILTIN_PLANAR_LAYOUT(ggsmswsc_4bpp,
+    .BITPLANES           = 4,
+    .PLANE_OFFSET        = { 0, 1, 2, 3 },
+    .PLANE_ROW_INCREMENT = { 4, 4, 4, 4 });
+
+// 4bpp Genesis / x68k, 32 bytes per tile: 2 pixels per byte, MS bits first
+//   [p0-1 r0: bp*], [p2-3 r0: bp*], [p4-5 r0: bp*], [p6-7 r0: bp*], ...
+BUILTIN_PACKED_LAYOUT(gens_4bpp,
+    .BITS_PER_PIXEL = 4,
+    .MS_PIXEL_FIRST = 1,
+    .BYTES_REVERSED = 0);
+
+// 8bpp GBA, 64 bytes per tile: one byte per pixel
+//   [p0 r0: bp*], [p1 r0: bp*], [p2 r0: bp*], ... [p7 r0: bp*], ...
+BUILTIN_PACKED_LAYOUT(gba_8bpp,
+    .BITS_PER_PIXEL = 8,
+    .MS_PIXEL_FIRST = 0,
+    .BYTES_REVERSED = 0);
+
+// 8bpp SNES, 64 bytes per tile: pairs of bitplanes intertwined row by row,
+// 16 bytes for each pair (1 & 2, 3 & 4, 5 & 6, 7 & 8)
+//   [r0, bp1], [r0, bp2], [r1, bp1], [r1, bp2], ... [r7, bp1], [r7, bp2]
+//   [r0, bp3], [r0, bp4], [r1, bp3], [r1, bp4], ... [r7, bp3], [r7, bp4]
+//   ...
+BUILTIN_PLANAR_LAYOUT(snes_8bpp,
+    .BITPLANES           = 8,
+    .PLANE_OFFSET        = { 0, 1, 16, 17, 32, 33, 48, 49 },
+    .PLANE_ROW_INCREMENT = { 2, 2, 2, 2, 2, 2, 2, 2 });
+
+
+
+static const rom_format builtin_formats[BIN_MODE_LAST] = {
+        [BIN_MODE_NES_1BPP]      = { "1bpp NES",        BUILTIN_ATTRIB(1), &nes_1bpp_layout,      NULL },
+        [BIN_MODE_NES_2BPP]      = { "2bpp NES",        BUILTIN_ATTRIB(2), &nes_2bpp_layout,      NULL },
+        [BIN_MODE_SNESGB_2BPP]   = { "2bpp SNES/GB",    BUILTIN_ATTRIB(2), &snesgb_2bpp_layout,   NULL },
+        [BIN_MODE_NGPC_2BPP]     = { "2bpp NGPC",       BUILTIN_ATTRIB(2), NULL,                  &ngpc_2bpp_layout },
+
+        [BIN_MODE_SNES_3BPP]     = { "3bpp SNES",       BUILTIN_ATTRIB(3), &snes_3bpp_layout,     NULL },
+
+        [BIN_MODE_GBA_4BPP]      = { "4bpp GBA",        BUILTIN_ATTRIB(4), NULL,                  &gba_4bpp_layout },
+        [BIN_MODE_SNES_4BPP]     = { "4bpp SNES",       BUILTIN_ATTRIB(4), &snespce_4bpp_layout,  NULL },
+        [BIN_MODE_GGSMSWSC_4BPP] = { "4bpp GG/SMS/WSC", BUILTIN_ATTRIB(4), &ggsmswsc_4bpp_layout, NULL },
+        [BIN_MODE_GENS_4BPP]     = { "4bpp GEN",        BUILTIN_ATTRIB(4), NULL,                  &gens_4bpp_layout },
+
+        [BIN_MODE_GBA_8BPP]      = { "8bpp GBA",        BUILTIN_ATTRIB(8), NULL,                  &gba_8bpp_layout },
+        [BIN_MODE_SNES_8BPP]     = { "8bpp SNES",       BUILTIN_ATTRIB(8), &snes_8bpp_layout,     NULL },
+};
+
+
+
+// User defined formats (see romimg_format_load_file), image modes BIN_MODE_LAST and up
+static rom_format * custom_formats      = NULL;
+static int          custom_format_count = 0;
+
+
+
+// Number of formats available, image modes run from 0 to count - 1
+int romimg_format_count(void)
+{
+    return BIN_MODE_LAST + custom_format_count;
+}
+
+
+// Returns the descriptor of an image mode, NULL if there isn't one
+const rom_format * romimg_format_get(int image_mode)
+{
+    if ((image_mode < 0) || (image_mode >= romimg_format_count()))
+        return NULL;
+
+    if (image_mode >= BIN_MODE_LAST)
+        return &custom_formats[image_mode - BIN_MODE_LAST];
+
+    return &builtin_formats[image_mode];
+}
+
+
+// Builds the layout tables and picks the tile kernels of a format, which
+// otherwise happens on its first decode / encode. Done up front before
+// images get decoded / encoded on several threads at once
+void romimg_format_prepare(const rom_format * p_format)
+{
+    if (NULL != p_format->p_PLANAR_LAYOUT) {
+        romimg_planar_get_tile_decoder(p_format->p_PLANAR_LAYOUT);
+        romimg_planar_get_tile_encoder(p_format->p_PLANAR_LAYOUT);
+    }
+    else {
+        romimg_packed_get_tile_decoder(p_format->p_PACKED_LAYOUT);
+        romimg_packed_get_tile_encoder(p_format->p_PACKED_LAYOUT);
+    }
+}
+
+
+
+// User defined format files
+//
+// A plain text file with one section per format, the section name being
+// the name shown in the export dialog. Blank lines and lines starting
+// with '#' are ignored.
+//
+//   [2bpp Virtual Boy]
+//   bpp            = 2          # bits per pixel
+//   tile           = 8x8        # tile size in pixels (only 8x8 for now)
+//   layout         = packed     # "planar" (bitplanes) or "packed" (linear)
+//   ms_pixel_first = yes        # packed: leftmost pixel in the MS bits of each byte
+//   bytes_reversed = no         # packed: bytes of each row stored last byte first (little-endian rows)
+//
+//   [4bpp Planar Example]
+//   bpp            = 4
+//   layout         = planar
+//   plane_offsets  = 0 1 16 17  # planar: byte offset of row 0 of each bitplane, bitplane 1 first
+//   row_stride     = 2          # planar: byte increment to the next row, one for all bitplanes or one each
+//
+// Bitplane layouts have to use every byte of the tile (bpp * 8 bytes) exactly once.
+
+#define FORMAT_FILE_LINE_MAX   256
+#define FORMAT_FILE_NAME_MAX   64
+
+// Settings of the format section currently being read
+typedef struct format_file_entry {
+    char name[FORMAT_FILE_NAME_MAX];
+    int  line;                                   // line of the section header, for messages
+    int  bits_per_pixel;
+    int  packed;
+    int  tile_width;
+    int  tile_height;
+    int  plane_offsets[ROM_PLANAR_MAX_PLANES];
+    int  plane_offset_count;
+    int  row_strides[ROM_PLANAR_MAX_PLANES];
+    int  row_stride_count;
+    int  ms_pixel_first;
+    int  bytes_reversed;
+} format_file_entry;
+
+
+
+static char * format_file_trim(char * p_str)
+{
+    char * p_end;
+
+    while ((*p_str == ' ') || (*p_str == '\t'))
+        p_str++;
+
+    p_end = p_str + strlen(p_str);
+    while ((p_end > p_str) && ((p_end[-1] == ' ') || (p_end[-1] == '\t') ||
+                               (p_end[-1] == '\r') || (p_end[-1] == '\n')))
+        *(--p_end) = '\0';
+
+    return p_str;
+}
+
+
+// Reads up to max_count space separated integers, returns how many or -1 on a bad value
+static int format_file_parse_ints(const char * p_value, int * p_ints, int max_count)
+{
+    char * p_end;
+    long   value;
+    int    count;
+
+    count = 0;
+
+    while (*p_value != '\0') {
+
+        value = strtol(p_value, &p_end, 0);
+        if ((p_end == p_value) || (count >= max_count) || (value < 0) || (value > 255))
+            return -1;
+
+        p_ints[count++] = (int)value;
+
+        p_value = p_end;
+        while ((*p_value == ' ') || (*p_value == '\t') || (*p_value == ','))
+            p_value++;
+    }
+
+    return count;
+}
+
+
+// Returns 1 for yes / true / 1, 0 for no / false / 0, -1 otherwise
+static int format_file_parse_bool(const char * p_value)
+{
+    if (!strcmp(p_value, "yes") || !strcmp(p_value, "true") || !strcmp(p_value, "1"))
+        return 1;
+    else if (!strcmp(p_value, "no") || !strcmp(p_value, "false") || !strcmp(p_value, "0"))
+        return 0;
+    else
+        return -1;
+}
+
+
+static int format_file_set_key(format_file_entry * p_entry, const char * p_key, const char * p_value)
+{
+    int value;
+
+    if (!strcmp(p_key, "bpp"))
+        return (1 == format_file_parse_ints(p_value, &p_entry->bits_per_pixel, 1)) ? 0 : -1;
+
+    else if (!strcmp(p_key, "tile"))
+        return (2 == sscanf(p_value, "%dx%d", &p_entry->tile_width, &p_entry->tile_height)) ? 0 : -1;
+
+    else if (!strcmp(p_key, "layout")) {
+        if (!strcmp(p_value, "planar"))
+            p_entry->packed = 0;
+        else if (!strcmp(p_value, "packed"))
+            p_entry->packed = 1;
+        else
+            return -1;
+    }
+    else if (!strcmp(p_key, "plane_offsets"))
+        return ((p_entry->plane_offset_count = format_file_parse_ints(p_value, p_entry->plane_offsets, ROM_PLANAR_MAX_PLANES)) > 0) ? 0 : -1;
+
+    else if (!strcmp(p_key, "row_stride"))
+        return ((p_entry->row_stride_count = format_file_parse_ints(p_value, p_entry->row_strides, ROM_PLANAR_MAX_PLANES)) > 0) ? 0 : -1;
+
+    else if (!strcmp(p_key, "ms_pixel_first")) {
+        if ((value = format_file_parse_bool(p_value)) < 0)
+            return -1;
+        p_entry->ms_pixel_first = value;
+    }
+    else if (!strcmp(p_key, "bytes_reversed")) {
+        if ((value = format_file_parse_bool(p_value)) < 0)
+            return -1;
+        p_entry->bytes_reversed = value;
+    }
+    else
+        return -1;
+
+    return 0;
+}
+
+
+// Checks that a bitplane layout uses every byte of a bpp * 8 byte tile exactly once
+static int format_file_check_planes(const format_file_entry * p_entry)
+{
+    uint64_t used_bytes;
+    int      tile_bytes, tile_byte, stride;
+    int      p, ty;
+
+    if (p_entry->plane_offset_count != p_entry->bits_per_pixel) {
+        printf("Tile format \"%s\" (line %d): needs %d plane_offsets\n", p_entry->name, p_entry->line, p_entry->bits_per_pixel);
+        return -1;
+    }
+
+    if ((p_entry->row_stride_count != 1) && (p_entry->row_stride_count != p_entry->bits_per_pixel)) {
+        printf("Tile format \"%s\" (line %d): needs 1 or %d row_stride values\n", p_entry->name, p_entry->line, p_entry->bits_per_pixel);
+        return -1;
+    }
+
+    tile_bytes = p_entry->bits_per_pixel * ROM_PLANAR_TILE_HEIGHT;
+    used_bytes = 0;
+
+    for (p=0; p < p_entry->bits_per_pixel; p++) {
+
+        stride = p_entry->row_strides[ (1 == p_entry->row_stride_count) ? 0 : p ];
+
+        for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++) {
+
+            tile_byte = p_entry->plane_offsets[p] + (ty * stride);
+
+            if ((tile_byte >= tile_bytes) || (used_bytes & (1ULL << tile_byte))) {
+                printf("Tile format \"%s\" (line %d): bitplane %d row %d is outside of the tile or overlaps another row\n",
+                       p_entry->name, p_entry->line, p + 1, ty);
+                return -1;
+            }
+
+            used_bytes |= 1ULL << tile_byte;
+        }
+    }
+
+    return 0;
+}
+
+
+// Validates a format section and adds it to the list of formats
+static int format_file_add_entry(const format_file_entry * p_entry)
+{
+    rom_format        * p_formats;
+    rom_format        * p_format;
+    rom_planar_layout * p_planar_layout = NULL;
+    rom_packed_layout * p_packed_layout = NULL;
+    char              * p_name;
+    int p;
+
+    for (p=0; p < romimg_format_count(); p++) {
+        if (!strcmp(p_entry->name, romimg_format_get(p)->NAME)) {
+            printf("Tile format \"%s\" (line %d): name is already in use\n", p_entry->name, p_entry->line);
+            return -1;
+        }
+    }
+
+    if ((p_entry->tile_width != ROM_PLANAR_TILE_WIDTH) || (p_entry->tile_height != ROM_PLANAR_TILE_HEIGHT)) {
+        printf("Tile format \"%s\" (line %d): only 8x8 tiles are supported\n", p_entry->name, p_entry->line);
+        return -1;
+    }
+
+    if (p_entry->packed) {
+
+        if ((p_entry->bits_per_pixel != 1) && (p_entry->bits_per_pixel != 2) &&
+            (p_entry->bits_per_pixel != 4) && (p_entry->bits_per_pixel != 8)) {
+            printf("Tile format \"%s\" (line %d): packed formats need 1, 2, 4 or 8 bpp\n", p_entry->name, p_entry->line);
+            return -1;
+        }
+
+        if (NULL == (p_packed_layout = calloc(1, sizeof(rom_packed_layout))))
+            return -1;
+
+        p_packed_layout->BITS_PER_PIXEL = (unsigned char)p_entry->bits_per_pixel;
+        p_packed_layout->MS_PIXEL_FIRST = (unsigned char)p_entry->ms_pixel_first;
+        p_packed_layout->BYTES_REVERSED = (unsigned char)p_entry->bytes_reversed;
+    }
+    else {
+        if ((p_entry->bits_per_pixel < 1) || (p_entry->bits_per_pixel > ROM_PLANAR_MAX_PLANES)) {
+            printf("Tile format \"%s\" (line %d): planar formats need 1 to 8 bpp\n", p_entry->name, p_entry->line);
+            return -1;
+        }
+
+        if (0 != format_file_check_planes(p_entry))
+            return -1;
+
+        if (NULL == (p_planar_layout = calloc(1, sizeof(rom_planar_layout))))
+            return -1;
+
+        p_planar_layout->BITPLANES = (unsigned char)p_entry->bits_per_pixel;
+
+        for (p=0; p < p_entry->bits_per_pixel; p++) {
+            p_planar_layout->PLANE_OFFSET[p]        = (unsigned char)p_entry->plane_offsets[p];
+            p_planar_layout->PLANE_ROW_INCREMENT[p] = (unsigned char)p_entry->row_strides[ (1 == p_entry->row_stride_count) ? 0 : p ];
+        }
+    }
+
+    // Grow the format list by one
+    p_name    = malloc(strlen(p_entry->name) + 1);
+    p_formats = realloc(custom_formats, (custom_format_count + 1) * sizeof(rom_format));
+
+    if ((NULL == p_name) || (NULL == p_formats)) {
+        free(p_name);
+        free(p_planar_layout);
+        free(p_packed_layout);
+        return -1;
+    }
+
+    strcpy(p_name, p_entry->name);
+    custom_formats = p_formats;
+
+    p_format = &custom_formats[custom_format_count++];
+    p_format->NAME            = p_name;
+    p_format->p_PLANAR_LAYOUT = p_planar_layout;
+    p_format->p_PACKED_LAYOUT = p_packed_layout;
+
+    p_format->ATTRIB.IMAGE_WIDTH_DEFAULT     = 128;
+    p_format->ATTRIB.TILE_PIXEL_WIDTH        = ROM_PLANAR_TILE_WIDTH;
+    p_format->ATTRIB.TILE_PIXEL_HEIGHT       = ROM_PLANAR_TILE_HEIGHT;
+    p_format->ATTRIB.BITS_PER_PIXEL          = (unsigned char)p_entry->bits_per_pixel;
+    p_format->ATTRIB.DECODED_NUM_COLORS      = 1U << p_entry->bits_per_pixel;
+    p_format->ATTRIB.DECODED_BYTES_PER_COLOR = 3;
+
+    // Build the layout tables and pick the tile kernels now, so a user
+    // defined format runs through the same kernels as the built-in ones
+    romimg_format_prepare(p_format);
+
+    return 0;
+}
+
+
+static void format_file_reset_entry(format_file_entry * p_entry, const char * p_name, int line)
+{
+    memset(p_entry, 0, sizeof(format_file_entry));
+
+    strncpy(p_entry->name, p_name, sizeof(p_entry->name) - 1);
+    p_entry->line        = line;
+    p_entry->tile_width  = ROM_PLANAR_TILE_WIDTH;
+    p_entry->tile_height = ROM_PLANAR_TILE_HEIGHT;
+}
+
+
+
+// Loads user defined tile formats from a format file (see above) and adds
+// them after the built-in ones. Invalid sections are skipped with a message.
+//
+// Returns the number of formats added, or -1 if the file can't be read
+int romimg_format_load_file(const char * p_filename)
+{
+    FILE            * p_file;
+    format_file_entry entry;
+    char              line_buf[FORMAT_FILE_LINE_MAX];
+    char            * p_line;
+    char            * p_value;
+    int               line, in_section, entry_ok, added;
+
+    if (NULL == (p_file = fopen(p_filename, "r")))
+        return -1;
+
+    line       = 0;
+    added      = 0;
+    in_section = 0;
+    entry_ok   = 0;
+
+    while (NULL != fgets(line_buf, sizeof(line_buf), p_file)) {
+
+        line++;
+        p_line = format_file_trim(line_buf);
+
+        if ((*p_line == '\0') || (*p_line == '#'))
+            continue;
+
+        // A new section: finish the previous one first
+        if (*p_line == '[') {
+
+            if (in_section && entry_ok && (0 == format_file_add_entry(&entry)))
+                added++;
+
+            p_value = strchr(p_line, ']');
+            if (NULL != p_value)
+                *p_value = '\0';
+
+            format_file_reset_entry(&entry, format_file_trim(p_line + 1), line);
+            in_section = 1;
+            entry_ok   = (NULL != p_value) && (entry.name[0] != '\0');
+
+            if (!entry_ok)
+                printf("%s line %d: bad format section name\n", p_filename, line);
+            continue;
+        }
+
+        // key = value, with an optional comment after the value
+        if (NULL != (p_value = strchr(p_line, '#')))
+            *p_value = '\0';
+
+        p_value = strchr(p_line, '=');
+
+        if (!in_section || (NULL == p_value)) {
+            printf("%s line %d: expected a [format name] or key = value\n", p_filename, line);
+            entry_ok = 0;
+            continue;
+        }
+
+        *(p_value++) = '\0';
+
+        if (0 != format_file_set_key(&entry, format_file_trim(p_line), format_file_trim(p_value))) {
+            printf("%s line %d: bad setting \"%s\"\n", p_filename, line, format_file_trim(p_line));
+            entry_ok = 0;
+        }
+    }
+
+    if (in_section && entry_ok && (0 == format_file_add_entry(&entry)))
+        added++;
+
+    fclose(p_file);
+
+    printf("Loaded %d tile format(s) from %s\n", added, p_filename);
+
+    return added;
+}
+
+
+
+// Tiles decoded at a time before being copied out to the image rows
+// (8 KB of scratch buffer in indexed + alpha mode, stays in the L1 cache)
+#define FORMAT_SCRATCH_TILES    64
+
+// Shared by the decode bands of an image
+typedef struct format_decode_ctx {
+    const rom_format           * p_format;
+    rom_gfx_data               * p_rom_gfx;
+    app_gfx_data               * p_app_gfx;          // p_data holds only the tile rows being decoded
+    romimg_planar_decode_tile_fn planar_decode_tile;
+    romimg_packed_decode_tile_fn packed_decode_tile;
+    long int                     tile_size_bytes;
+    int                          first_tile_row;     // image tile row at the top of p_app_gfx->p_data
+} format_decode_ctx;
+
+
+
+// Decodes tile rows first_row to first_row + row_count - 1 (counted
+// from the top of the rows being decoded)
+//
+// Tiles are decoded into a small tile-major scratch buffer (each tile's
+// pixels contiguous, so the kernels read and write sequentially), which
+// then gets copied out to the image rows a block of tiles at a time
+static void format_decode_band(int band, int first_row, int row_count, void * p_band_ctx)
+{
+    format_decode_ctx  * p_ctx     = (format_decode_ctx *)p_band_ctx;
+    const rom_format   * p_format  = p_ctx->p_format;
+    rom_gfx_data       * p_rom_gfx = p_ctx->p_rom_gfx;
+    app_gfx_data       * p_app_gfx = p_ctx->p_app_gfx;
+    app_gfx_data    scratch_gfx;
+    unsigned char   scratch[FORMAT_SCRATCH_TILES * ROM_PLANAR_TILE_WIDTH * ROM_PLANAR_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    unsigned char * p_scratch_tile;
+    long int      scratch_tile_bytes;
+    long int      rom_offset;
+    long int      tiles_per_row;
+    unsigned char rom_ended;
+
+    int x, y, block_x, block_tiles;
+
+    (void)band;
+
+    // The scratch buffer is decoded as an image one tile wide
+    scratch_gfx        = *p_app_gfx;
+    scratch_gfx.width  = p_format->ATTRIB.TILE_PIXEL_WIDTH;
+    scratch_gfx.p_data = scratch;
+    scratch_tile_bytes = p_format->ATTRIB.TILE_PIXEL_WIDTH * p_format->ATTRIB.TILE_PIXEL_HEIGHT * p_app_gfx->bytes_per_pixel;
+
+    // Each tile has a fixed spot in the ROM, so start at the first tile of the band
+    tiles_per_row = p_app_gfx->width / p_format->ATTRIB.TILE_PIXEL_WIDTH;
+    rom_offset = (long int)(p_ctx->first_tile_row + first_row) * tiles_per_row * p_ctx->tile_size_bytes;
+    rom_ended = 0;
+
+    for (y=first_row; y < (first_row + row_count); y++) {
+        // Decode left-to-right, one scratch buffer worth of tiles at a time
+        for (block_x=0; block_x < tiles_per_row; block_x += FORMAT_SCRATCH_TILES) {
+
+            block_tiles = tiles_per_row - block_x;
+            if (block_tiles > FORMAT_SCRATCH_TILES)
+                block_tiles = FORMAT_SCRATCH_TILES;
+
+            p_scratch_tile = scratch;
+
+            for (x=0; x < block_tiles; x++) {
+
+                // Set a flag if there isn't enough rom image data left
+                // to read a complete tile. This can happen if the number
+                // of tiles and their size isn't an even multiple of the
+                // total image width
+                //
+                // Any extra bytes which don't get decoded are stored as
+                // a Gimp metadata parasite attached to the image. Those
+                // get retrieved during export/save and re-appended.
+                //
+                // The remaining tiles in the image are set to transparent
+                // to indicate they don't contain data (and later shouldn't
+                // be used to encode data)
+                if ( (rom_offset + p_ctx->tile_size_bytes) > p_rom_gfx->size)
+                    rom_ended = 1;
+
+                // Decode the whole tile
+                if (rom_ended)
+                    romimg_set_transparent_tile(p_scratch_tile, &scratch_gfx, p_format->ATTRIB);
+                else if (NULL != p_ctx->packed_decode_tile)
+                    p_ctx->packed_decode_tile(p_rom_gfx->p_data + rom_offset,
+                                              p_format->p_PACKED_LAYOUT,
+                                              p_scratch_tile,
+                                              &scratch_gfx);
+                else
+                    p_ctx->planar_decode_tile(p_rom_gfx->p_data + rom_offset,
+                                              p_format->p_PLANAR_LAYOUT,
+                                              p_scratch_tile,
+                                              &scratch_gfx);
+
+                // Now advance to the start of the next tile
+                rom_offset     += p_ctx->tile_size_bytes;
+                p_scratch_tile += scratch_tile_bytes;
+            }
+
+            // Reorder the block of tiles into the image rows
+            romimg_copy_tiles_to_image(scratch,
+                                       block_tiles,
+                                       romimg_calc_appimg_offset(block_x, y, 0, p_app_gfx, p_format->ATTRIB),
+                                       p_app_gfx,
+                                       p_format->ATTRIB);
+        }
+    }
+}
+
+
+
+// Decodes image rows first_row to first_row + row_count - 1 into p_rows
+// (row_count rows of the image width), both whole numbers of tile rows
+static int format_decode_image(const rom_format * p_format,
+                               rom_gfx_data * p_rom_gfx,
+                               app_gfx_data * p_app_gfx,
+                               int first_row,
+                               int row_count,
+                               unsigned char * p_rows)
+{
+    format_decode_ctx ctx;
+    app_gfx_data rows_gfx;
+    int tile_rows, tiles_per_row;
+
+    // Check incoming buffers & vars
+    if ((p_rom_gfx->p_data  == NULL) ||
+        (p_rows             == NULL) ||
+        (p_app_gfx->width   == 0) ||
+        (p_app_gfx->height  == 0))
+        return -1;
+
+    if ((first_row < 0) || (row_count < 0) ||
+        ((unsigned int)(first_row + row_count) > p_app_gfx->height) ||
+        (first_row % p_format->ATTRIB.TILE_PIXEL_HEIGHT) ||
+        (row_count % p_format->ATTRIB.TILE_PIXEL_HEIGHT))
+        return -1;
+
+    // The bands see the rows being decoded as the whole image
+    rows_gfx        = *p_app_gfx;
+    rows_gfx.height = row_count;
+    rows_gfx.p_data = p_rows;
+
+    ctx.p_format           = p_format;
+    ctx.p_rom_gfx          = p_rom_gfx;
+    ctx.p_app_gfx          = &rows_gfx;
+    ctx.planar_decode_tile = NULL;
+    ctx.packed_decode_tile = NULL;
+    ctx.tile_size_bytes    = romimg_calc_tile_size_bytes(p_format->ATTRIB);
+    ctx.first_tile_row     = first_row / p_format->ATTRIB.TILE_PIXEL_HEIGHT;
+
+    // Use the fastest tile decoder the CPU supports
+    // (picked here, before any worker threads start)
+    if (NULL != p_format->p_PACKED_LAYOUT)
+        ctx.packed_decode_tile = romimg_packed_get_tile_decoder(p_format->p_PACKED_LAYOUT);
+    else
+        ctx.planar_decode_tile = romimg_planar_get_tile_decoder(p_format->p_PLANAR_LAYOUT);
+
+    // Decode the rows top-to-bottom, in bands of tile rows spread over the worker threads
+    tile_rows     = row_count / p_format->ATTRIB.TILE_PIXEL_HEIGHT;
+    tiles_per_row = p_app_gfx->width  / p_format->ATTRIB.TILE_PIXEL_WIDTH;
+
+    romimg_run_bands(format_decode_band,
+                     &ctx,
+                     tile_rows,
+                     romimg_band_count(tile_rows, tiles_per_row));
+
+    // Return success
+    return 0;
+}
+
+
+
+// Shared by the encode bands of an image
+typedef struct format_encode_ctx {
+    const rom_format           * p_format;
+    app_gfx_data               * p_app_gfx;          // p_data holds only the tile rows being encoded
+    unsigned char              * p_rom_data;         // encoded data of those rows
+    romimg_planar_encode_tile_fn planar_encode_tile;
+    romimg_packed_encode_tile_fn packed_encode_tile;
+    long int                     tile_size_bytes;
+    unsigned int               * p_empty_tile_counts;  // one per band
+} format_encode_ctx;
+
+
+
+// Encodes tile rows first_row to first_row + row_count - 1 (counted from
+// the top of the rows being encoded), counting the band's empty tiles
+// into its own slot
+static void format_encode_band(int band, int first_row, int row_count, void * p_band_ctx)
+{
+    format_encode_ctx  * p_ctx     = (format_encode_ctx *)p_band_ctx;
+    const rom_format   * p_format  = p_ctx->p_format;
+    app_gfx_data       * p_app_gfx = p_ctx->p_app_gfx;
+    unsigned char * p_image_pixel;
+    long int      rom_offset;
+    long int      tiles_per_row;
+    unsigned int  transparency_flag;
+    unsigned int  empty_tile_count;
+
+    int x,y;
+
+    // Each tile has a fixed spot in the ROM, so start at the first tile of the band
+    tiles_per_row = p_app_gfx->width / p_format->ATTRIB.TILE_PIXEL_WIDTH;
+    rom_offset = (long int)first_row * tiles_per_row * p_ctx->tile_size_bytes;
+    empty_tile_count = 0;
+
+    for (y=first_row; y < (first_row + row_count); y++) {
+        // Encode left-to-right
+        for (x=0; x < tiles_per_row; x++) {
+
+            // Set up the pointer to the top-left pixel of the tile in the source image buffer
+            p_image_pixel = romimg_calc_appimg_offset(x, y, 0, p_app_gfx, p_format->ATTRIB);
+
+            // Encode the whole tile, counting its transparent pixels along the way
+            if (NULL != p_ctx->packed_encode_tile)
+                transparency_flag = p_ctx->packed_encode_tile(p_image_pixel,
+                                                              p_format->p_PACKED_LAYOUT,
+                                                              p_ctx->p_rom_data + rom_offset,
+                                                              p_app_gfx);
+            else
+                transparency_flag = p_ctx->planar_encode_tile(p_image_pixel,
+                                                              p_format->p_PLANAR_LAYOUT,
+                                                              p_ctx->p_rom_data + rom_offset,
+                                                              p_app_gfx);
+
+            romimg_log_transparent_tiles(transparency_flag, &empty_tile_count, p_app_gfx, p_format->ATTRIB);
+
+            // Now advance to the start of the next tile
+            rom_offset += p_ctx->tile_size_bytes;
+        }
+    }
+
+    p_ctx->p_empty_tile_counts[band] = empty_tile_count;
+}
+
+
+
+// Encodes image rows first_row to first_row + row_count - 1 (whole tile
+// rows, row_count rows of the image width in p_rows) to p_rom_data, and
+// adds the number of empty (fully transparent) tiles to *p_empty_tile_count
+static int format_encode_image(const rom_format * p_format,
+                               app_gfx_data * p_app_gfx,
+                               int first_row,
+                               int row_count,
+                               unsigned char * p_rows,
+                               unsigned char * p_rom_data,
+                               unsigned int  * p_empty_tile_count)
+{
+    format_encode_ctx ctx;
+    app_gfx_data rows_gfx;
+    int tile_rows, tiles_per_row;
+    int band, band_count;
+
+    // Check incoming buffers & vars
+    if ((p_rows            == NULL) ||
+        (p_rom_data        == NULL) ||
+        (p_app_gfx->width  == 0) ||
+        (p_app_gfx->height == 0))
+        return -1;
+
+    if ((first_row < 0) || (row_count < 0) ||
+        ((unsigned int)(first_row + row_count) > p_app_gfx->height) ||
+        (first_row % p_format->ATTRIB.TILE_PIXEL_HEIGHT) ||
+        (row_count % p_format->ATTRIB.TILE_PIXEL_HEIGHT))
+        return -1;
+
+    // The bands see the rows being encoded as the whole image
+    rows_gfx        = *p_app_gfx;
+    rows_gfx.height = row_count;
+    rows_gfx.p_data = p_rows;
+
+    tile_rows     = row_count / p_format->ATTRIB.TILE_PIXEL_HEIGHT;
+    tiles_per_row = p_app_gfx->width / p_format->ATTRIB.TILE_PIXEL_WIDTH;
+    band_count    = romimg_band_count(tile_rows, tiles_per_row);
+
+    ctx.p_format           = p_format;
+    ctx.p_app_gfx          = &rows_gfx;
+    ctx.p_rom_data         = p_rom_data;
+    ctx.planar_encode_tile = NULL;
+    ctx.packed_encode_tile = NULL;
+    ctx.tile_size_bytes    = romimg_calc_tile_size_bytes(p_format->ATTRIB);
+
+    if (NULL == (ctx.p_empty_tile_counts = calloc(band_count, sizeof(unsigned int))) )
+        return -1;
+
+    // Use the fastest tile encoder the CPU supports
+    // (picked here, before any worker threads start)
+    if (NULL != p_format->p_PACKED_LAYOUT)
+        ctx.packed_encode_tile = romimg_packed_get_tile_encoder(p_format->p_PACKED_LAYOUT);
+    else
+        ctx.planar_encode_tile = romimg_planar_get_tile_encoder(p_format->p_PLANAR_LAYOUT);
+
+    // Encode the rows top-to-bottom, in bands of tile rows spread over the worker threads
+    romimg_run_bands(format_encode_band,
+                     &ctx,
+                     tile_rows,
+                     band_count);
+
+    // Add up the empty tiles found by each band
+    for (band=0; band < band_count; band++)
+        *p_empty_tile_count += ctx.p_empty_tile_counts[band];
+
+    free(ctx.p_empty_tile_counts);
+
+    // Return success
+    return 0;
+}
+
+
+
+// Sets up everything for decoding except the pixels: image size,
+// surplus bytes, empty tile count and color map
+//
+// The pixels can then be decoded in strips with romimg_format_decode_rows()
+int romimg_format_decode_begin(const rom_format * p_format,
+                               rom_gfx_data * p_rom_gfx,
+                               app_gfx_data * p_app_gfx,
+                               app_color_data * p_colorpal)
+{
+    // Calculate width and height
+    romimg_calc_decoded_size(p_rom_gfx->size, p_app_gfx, p_format->ATTRIB);
+
+
+    // Set aside any surplus bytes if present
+    if (0 != romimg_stash_surplus_bytes(p_app_gfx,
+                                        p_rom_gfx))
+        return -1;
+
+    // Count the tiles past the end of the rom data, so callers
+    // can tell if the image needs alpha before decoding it
+    romimg_count_empty_tiles(p_rom_gfx->size,
+                             p_app_gfx,
+                             p_format->ATTRIB);
+
+
+    // Set up info about the color map
+    p_colorpal->size            = p_format->ATTRIB.DECODED_NUM_COLORS;
+    p_colorpal->bytes_per_pixel = p_format->ATTRIB.DECODED_BYTES_PER_COLOR;
+
+    // Allocate the color map buffer, abort if it fails
+    if (NULL == (p_colorpal->p_data = malloc(p_colorpal->size * p_colorpal->bytes_per_pixel)) )
+        return -1;
+
+    // Read the color map data
+    if (0 != romimg_load_color_data(p_colorpal))
+        return -1;
+
+
+    // Return success
+    return 0;
+}
+
+
+
+// Decodes image rows first_row to first_row + row_count - 1 (whole tile rows)
+// into p_rows, which holds row_count rows of the image width
+int romimg_format_decode_rows(const rom_format * p_format,
+                              rom_gfx_data * p_rom_gfx,
+                              app_gfx_data * p_app_gfx,
+                              int first_row,
+                              int row_count,
+                              unsigned char * p_rows)
+{
+    return format_decode_image(p_format,
+                               p_rom_gfx,
+                               p_app_gfx,
+                               first_row,
+                               row_count,
+                               p_rows);
+}
+
+
+
+int romimg_format_decode(const rom_format * p_format,
+                         rom_gfx_data * p_rom_gfx,
+                         app_gfx_data * p_app_gfx,
+                         app_color_data * p_colorpal)
+{
+    if (0 != romimg_format_decode_begin(p_format,
+                                        p_rom_gfx,
+                                        p_app_gfx,
+                                        p_colorpal))
+        return -1;
+
+    // Allocate the incoming image buffer, abort if it fails
+    if (NULL == (p_app_gfx->p_data = malloc(p_app_gfx->width * p_app_gfx->height * p_app_gfx->bytes_per_pixel)) )
+        return -1;
+
+
+    // Read the image data
+    if (0 != format_decode_image(p_format,
+                                 p_rom_gfx,
+                                 p_app_gfx,
+                                 0,
+                                 p_app_gfx->height,
+                                 p_app_gfx->p_data))
+        return -1;
+
+
+    // Return success
+    return 0;
+}
+
+
+
+// Encodes image rows first_row to first_row + row_count - 1 (whole tile rows)
+// from p_rows to p_rom_data, which needs room for romimg_calc_encoded_size()
+// of that many rows. Empty tiles are added to *p_empty_tile_count, the caller
+// trims that many tiles off the end of the rom once all rows are encoded
+int romimg_format_encode_rows(const rom_format * p_format,
+                              app_gfx_data * p_app_gfx,
+                              int first_row,
+                              int row_count,
+                              unsigned char * p_rows,
+                              unsigned char * p_rom_data,
+                              unsigned int  * p_empty_tile_count)
+{
+    return format_encode_image(p_format,
+                               p_app_gfx,
+                               first_row,
+                               row_count,
+                               p_rows,
+                               p_rom_data,
+                               p_empty_tile_count);
+}
+
+
+
+int romimg_format_encode(const rom_format * p_format,
+                         rom_gfx_data * p_rom_gfx,
+                         app_gfx_data * p_app_gfx)
+{
+    unsigned int empty_tile_count;
+
+    // TODO: Warn if number of colors > expected
+
+    // Set output file size based on Width, Height and bit packing
+    p_rom_gfx->size = romimg_calc_encoded_size(p_app_gfx, p_format->ATTRIB);
+
+    // Allocate the output buffer with room for any surplus bytes
+    // after the tiles, so they can be appended in place. Abort if it fails
+    if (NULL == (p_rom_gfx->p_data = malloc(p_rom_gfx->size + p_app_gfx->surplus_bytes_size)) )
+        return -1;
+
+
+    // Encode the image data
+    empty_tile_count = 0;
+
+    if ((0 == p_rom_gfx->size) ||
+        (0 != format_encode_image(p_format,
+                                  p_app_gfx,
+                                  0,
+                                  p_app_gfx->height,
+                                  p_app_gfx->p_data,
+                                  p_rom_gfx->p_data,
+                                  &empty_tile_count)))
+        return -1;
+
+    // Substract transparent/empty tiles from rom image file size
+    // (tiles past the end of the rom data when it was loaded)
+    p_rom_gfx->size -= (empty_tile_count * romimg_calc_tile_size_bytes(p_format->ATTRIB));
+
+
+    // Append any surplus bytes if present
+    if (0 != romimg_append_surplus_bytes(p_app_gfx,
+                                         p_rom_gfx))
+        return -1;
+
+    // Return success
+    return 0;
+}
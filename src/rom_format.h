@@ -0,0 +1,50 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_FORMAT_FILE_HEADER
+#define ROM_FORMAT_FILE_HEADER
+
+#include "lib_rom_bin.h"
+#include "rom_planar.h"
+#include "rom_packed.h"
+
+    // Describes one rom tile format for the generic codec (see rom_format.c)
+    //
+    // The tile size in bytes (also the stride from one tile to the next) follows
+    // from the tile size and bits per pixel. Exactly one of the layouts is set.
+    typedef struct rom_format {
+        const char        * NAME;              // shown in the export dialog
+        rom_gfx_attrib      ATTRIB;
+        rom_planar_layout * p_PLANAR_LAYOUT;   // bitplane formats: byte offset and row stride of each bitplane
+        rom_packed_layout * p_PACKED_LAYOUT;   // packed (linear) formats: pixel and byte order of each row
+    } rom_format;
+
+
+    int romimg_format_count(void);
+    const rom_format * romimg_format_get(int);
+    int romimg_format_load_file(const char *);
+    void romimg_format_prepare(const rom_format *);
+
+    int romimg_format_decode(const rom_format *, rom_gfx_data *, app_gfx_data *, app_color_data *);
+    int romimg_format_decode_begin(const rom_format *, rom_gfx_data *, app_gfx_data *, app_color_data *);
+    int romimg_format_decode_rows(const rom_format *, rom_gfx_data *, app_gfx_data *, int, int, unsigned char *);
+    int romimg_format_encode(const rom_format *, rom_gfx_data *, app_gfx_data *);
+    int romimg_format_encode_rows(const rom_format *, app_gfx_data *, int, int, unsigned char *, unsigned char *, unsigned int *);
+
+#endif // ROM_FORMAT_FILE_HEADER
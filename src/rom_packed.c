@@ -0,0 +1,184 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#include "rom_packed.h"
+#include "rom_utils.h"
+#include "rom_portable.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+// Tile kernels for each codec level, NULL if there isn't one
+static const romimg_packed_decode_tile_fn packed_decoders[ROMIMG_CPU_LEVEL_COUNT] = {
+        [ROMIMG_CPU_LEVEL_SCALAR] = romimg_packed_decode_tile_scalar,
+#ifdef ROM_DISPATCH_X86
+        [ROMIMG_CPU_LEVEL_BMI2]   = romimg_packed_decode_tile_bmi2,
+        [ROMIMG_CPU_LEVEL_SSE2]   = romimg_packed_decode_tile_sse2,
+        [ROMIMG_CPU_LEVEL_AVX2]   = romimg_packed_decode_tile_avx2,
+#endif
+};
+
+static const romimg_packed_encode_tile_fn packed_encoders[ROMIMG_CPU_LEVEL_COUNT] = {
+        [ROMIMG_CPU_LEVEL_SCALAR] = romimg_packed_encode_tile_scalar,
+#ifdef ROM_DISPATCH_X86
+        [ROMIMG_CPU_LEVEL_BMI2]   = romimg_packed_encode_tile_bmi2,
+        [ROMIMG_CPU_LEVEL_SSE2]   = romimg_packed_encode_tile_sse2,
+        [ROMIMG_CPU_LEVEL_AVX2]   = romimg_packed_encode_tile_avx2,
+#endif
+};
+
+
+
+// Tile kernels of a codec level for the layout: layouts with their own
+// constant-layout portable kernels use those at the SWAR level (there are no generic ones)
+static romimg_packed_decode_tile_fn packed_level_decoder(const rom_packed_layout * p_layout, int level)
+{
+    if ((ROMIMG_CPU_LEVEL_SWAR == level) && (NULL != p_layout->PORTABLE_DECODE_TILE))
+        return p_layout->PORTABLE_DECODE_TILE;
+
+    return packed_decoders[level];
+}
+
+
+static romimg_packed_encode_tile_fn packed_level_encoder(const rom_packed_layout * p_layout, int level)
+{
+    if ((ROMIMG_CPU_LEVEL_SWAR == level) && (NULL != p_layout->PORTABLE_ENCODE_TILE))
+        return p_layout->PORTABLE_ENCODE_TILE;
+
+    return packed_encoders[level];
+}
+
+
+
+// Self-check: decode a test tile at the given level and compare with the scalar decoder
+static int packed_check_decoder(int level, const void * p_ctx)
+{
+    const rom_packed_layout * p_layout = p_ctx;
+    unsigned char tile[ROM_PACKED_TILE_HEIGHT * 8];
+    unsigned char image_ref[ROM_PACKED_TILE_WIDTH * ROM_PACKED_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    unsigned char image_test[ROM_PACKED_TILE_WIDTH * ROM_PACKED_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    app_gfx_data  app_gfx;
+
+    if ((NULL == packed_level_decoder(p_layout, level)) || !romimg_cpu_level_supported(level))
+        return 0;
+
+    romimg_dispatch_fill_test_pattern(tile, sizeof(tile), 3);
+
+    app_gfx.width  = ROM_PACKED_TILE_WIDTH;
+    app_gfx.height = ROM_PACKED_TILE_HEIGHT;
+
+    for (app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED;
+         app_gfx.bytes_per_pixel <= BIN_BITDEPTH_INDEXED_ALPHA;
+         app_gfx.bytes_per_pixel++) {
+
+        memset(image_ref,  0, sizeof(image_ref));
+        memset(image_test, 0, sizeof(image_test));
+
+        romimg_packed_decode_tile_scalar(tile, p_layout, image_ref, &app_gfx);
+        packed_level_decoder(p_layout, level)(tile, p_layout, image_test, &app_gfx);
+
+        if (0 != memcmp(image_ref, image_test, sizeof(image_ref))) {
+            printf("Packed tile decoder self-check failed: %s\n", romimg_cpu_level_name(level));
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+// Self-check: encode a test image at the given level and compare with the scalar encoder
+static int packed_check_encoder(int level, const void * p_ctx)
+{
+    const rom_packed_layout * p_layout = p_ctx;
+    unsigned char image[ROM_PACKED_TILE_WIDTH * ROM_PACKED_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    unsigned char tile_ref[ROM_PACKED_TILE_HEIGHT * 8];
+    unsigned char tile_test[ROM_PACKED_TILE_HEIGHT * 8];
+    app_gfx_data  app_gfx;
+    unsigned int  transparent_ref, transparent_test;
+    int c;
+
+    if ((NULL == packed_level_encoder(p_layout, level)) || !romimg_cpu_level_supported(level))
+        return 0;
+
+    // Pixel indexes with all bits in use, about half of them transparent
+    romimg_dispatch_fill_test_pattern(image, sizeof(image), 4);
+    for (c=1; c < (int)sizeof(image); c += 2)
+        image[c] = (image[c] & 0x01) ? 0xFF : 0x00;
+
+    app_gfx.width  = ROM_PACKED_TILE_WIDTH;
+    app_gfx.height = ROM_PACKED_TILE_HEIGHT;
+
+    for (app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED;
+         app_gfx.bytes_per_pixel <= BIN_BITDEPTH_INDEXED_ALPHA;
+         app_gfx.bytes_per_pixel++) {
+
+        memset(tile_ref,  0, sizeof(tile_ref));
+        memset(tile_test, 0, sizeof(tile_test));
+
+        transparent_ref  = romimg_packed_encode_tile_scalar(image, p_layout, tile_ref, &app_gfx);
+        transparent_test = packed_level_encoder(p_layout, level)(image, p_layout, tile_test, &app_gfx);
+
+        if ((transparent_ref != transparent_test) ||
+            (0 != memcmp(tile_ref, tile_test, sizeof(tile_ref)))) {
+            printf("Packed tile encoder self-check failed: %s\n", romimg_cpu_level_name(level));
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+// Returns the fastest tile decoder for the layout which the running CPU supports
+// (and which decodes identically to the scalar decoder)
+romimg_packed_decode_tile_fn romimg_packed_get_tile_decoder(rom_packed_layout * p_layout)
+{
+    if (NULL == p_layout->DECODE_TILE)
+        p_layout->DECODE_TILE = packed_level_decoder(p_layout, romimg_dispatch_select_level(packed_check_decoder, p_layout));
+
+    return p_layout->DECODE_TILE;
+}
+
+
+// Returns the fastest tile encoder for the layout which the running CPU supports
+// (and which encodes identically to the scalar encoder)
+romimg_packed_encode_tile_fn romimg_packed_get_tile_encoder(rom_packed_layout * p_layout)
+{
+    if (NULL == p_layout->ENCODE_TILE)
+        p_layout->ENCODE_TILE = packed_level_encoder(p_layout, romimg_dispatch_select_level(packed_check_encoder, p_layout));
+
+    return p_layout->ENCODE_TILE;
+}
+
+
+
+// Scalar tile kernels (see rom_portable.h)
+void romimg_packed_decode_tile_scalar(const unsigned char * p_tile, const rom_packed_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    packed_scalar_decode_tile(p_tile, p_layout, p_image_pixel, p_app_gfx);
+}
+
+
+unsigned int romimg_packed_encode_tile_scalar(const unsigned char * p_image_pixel, const rom_packed_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    return packed_scalar_encode_tile(p_image_pixel, p_layout, p_tile, p_app_gfx);
+}
@@ -0,0 +1,76 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_PACKED_FILE_HEADER
+#define ROM_PACKED_FILE_HEADER
+
+#include <stdint.h>
+
+#include "lib_rom_bin.h"
+#include "rom_dispatch.h"
+
+#define ROM_PACKED_TILE_WIDTH    8
+#define ROM_PACKED_TILE_HEIGHT   8
+
+    struct rom_packed_layout;
+
+    // Decodes one complete 8x8 tile into the image buffer, starting at the top-left pixel of the tile
+    typedef void (*romimg_packed_decode_tile_fn)(const unsigned char *, const struct rom_packed_layout *, unsigned char *, app_gfx_data *);
+
+    // Encodes one complete 8x8 tile from the image buffer, starting at the top-left pixel of the tile
+    // Returns the number of transparent pixels found in the tile (see romimg_log_transparent_pixel)
+    typedef unsigned int (*romimg_packed_encode_tile_fn)(const unsigned char *, const struct rom_packed_layout *, unsigned char *, app_gfx_data *);
+
+
+    // Describes how the pixels of an 8x8 packed (linear) tile are stored
+    //
+    // Each tile row takes BITS_PER_PIXEL bytes, with all bits of a pixel next
+    // to each other. Without any flags set the leftmost pixel is in the LS bits
+    // of the first byte of the row (GBA)
+    typedef struct rom_packed_layout {
+        unsigned char BITS_PER_PIXEL;       // 1, 2, 4 or 8
+        unsigned char MS_PIXEL_FIRST;       // TRUE: leftmost pixel of each byte is in its MS bits
+        unsigned char BYTES_REVERSED;       // TRUE: the bytes of a tile row are stored last byte first
+
+        romimg_packed_decode_tile_fn DECODE_TILE;    // selected once per process (see rom_dispatch.c)
+        romimg_packed_encode_tile_fn ENCODE_TILE;
+
+        romimg_packed_decode_tile_fn PORTABLE_DECODE_TILE;   // optional constant-layout scalar kernels, used at
+        romimg_packed_encode_tile_fn PORTABLE_ENCODE_TILE;   // the SWAR level (see rom_format.c)
+    } rom_packed_layout;
+
+
+    romimg_packed_decode_tile_fn romimg_packed_get_tile_decoder(rom_packed_layout *);
+    romimg_packed_encode_tile_fn romimg_packed_get_tile_encoder(rom_packed_layout *);
+
+    void romimg_packed_decode_tile_scalar(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_packed_encode_tile_scalar(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+
+#ifdef ROM_DISPATCH_X86
+    void romimg_packed_decode_tile_bmi2(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_packed_encode_tile_bmi2(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+
+    void romimg_packed_decode_tile_sse2(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+    void romimg_packed_decode_tile_avx2(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+
+    unsigned int romimg_packed_encode_tile_sse2(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_packed_encode_tile_avx2(const unsigned char *, const rom_packed_layout *, unsigned char *, app_gfx_data *);
+#endif
+
+#endif // ROM_PACKED_FILE_HEADER
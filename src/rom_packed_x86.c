@@ -0,0 +1,579 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#include "rom_packed.h"
+#include "rom_planar.h"
+
+#ifdef ROM_DISPATCH_X86
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "rom_simd_x86.h"
+
+
+// BMI2 tile decode / encode
+//
+// A packed tile row is a little-endian bit field of 8 pixels. PDEP scatters
+// its fields into the 8 pixel bytes of a row in one instruction, PEXT gathers
+// them back. The resulting pixel bytes are in bit field order, which is then
+// fixed up with a few byte swaps for formats that store the leftmost pixel in
+// the MS bits of a byte (Genesis, NGPC) or the bytes of a row in reverse (NGPC).
+
+#define BMI2_TARGET "bmi2,popcnt"
+
+
+// Reverse the order of the pixel bytes within each group of N (1, 2, 4 or 8)
+static inline uint64_t bmi2_reverse_pixel_groups(uint64_t x, int pixels_per_group)
+{
+    if (pixels_per_group >= 2)
+        x = ((x & 0x00FF00FF00FF00FFULL) << 8)  | ((x >> 8)  & 0x00FF00FF00FF00FFULL);
+    if (pixels_per_group >= 4)
+        x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+    if (pixels_per_group >= 8)
+        x = (x << 32) | (x >> 32);
+
+    return x;
+}
+
+
+// Load / store the little-endian bit field of a tile row (1, 2, 4 or 8 bytes)
+// Fixed size copies compile to single moves, unlike one with a variable size
+static inline uint64_t bmi2_load_row(const unsigned char * p_src, int row_bytes)
+{
+    uint64_t row_fields;
+    uint32_t row_fields_32;
+    uint16_t row_fields_16;
+
+    switch (row_bytes) {
+        case 8:  memcpy(&row_fields,    p_src, 8); return row_fields;
+        case 4:  memcpy(&row_fields_32, p_src, 4); return row_fields_32;
+        case 2:  memcpy(&row_fields_16, p_src, 2); return row_fields_16;
+        default: return *p_src;
+    }
+}
+
+
+static inline void bmi2_store_row(unsigned char * p_dest, uint64_t row_fields, int row_bytes)
+{
+    uint32_t row_fields_32;
+    uint16_t row_fields_16;
+
+    switch (row_bytes) {
+        case 8:  memcpy(p_dest, &row_fields, 8); break;
+        case 4:  row_fields_32 = (uint32_t)row_fields; memcpy(p_dest, &row_fields_32, 4); break;
+        case 2:  row_fields_16 = (uint16_t)row_fields; memcpy(p_dest, &row_fields_16, 2); break;
+        default: *p_dest = (unsigned char)row_fields; break;
+    }
+}
+
+
+// Convert between bit field order and left-to-right pixel order (works both ways)
+static inline uint64_t bmi2_reorder_pixels(uint64_t x, const rom_packed_layout * p_layout)
+{
+    int pixels_per_byte;
+
+    pixels_per_byte = 8 / p_layout->BITS_PER_PIXEL;
+
+    if (p_layout->MS_PIXEL_FIRST)
+        x = bmi2_reverse_pixel_groups(x, pixels_per_byte);
+
+    // Reversed bytes: swap all pixels, then restore the pixel order inside each byte
+    if (p_layout->BYTES_REVERSED)
+        x = bmi2_reverse_pixel_groups(__builtin_bswap64(x), pixels_per_byte);
+
+    return x;
+}
+
+
+
+__attribute__((target(BMI2_TARGET)))
+void romimg_packed_decode_tile_bmi2(const unsigned char * p_tile, const rom_packed_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    uint64_t        row_fields, row_pixels, row_alpha[2], field_mask;
+    unsigned char * p_row;
+    long int        image_stride;
+    int ty;
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+    field_mask   = 0x0101010101010101ULL * ((1U << p_layout->BITS_PER_PIXEL) - 1);
+
+    for (ty=0; ty < ROM_PACKED_TILE_HEIGHT; ty++) {
+
+        row_fields = bmi2_load_row(p_tile + (ty * p_layout->BITS_PER_PIXEL), p_layout->BITS_PER_PIXEL);
+        row_pixels = bmi2_reorder_pixels(_pdep_u64(row_fields, field_mask), p_layout);
+        p_row = p_image_pixel + (ty * image_stride);
+
+        if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+            // Interleave with opaque alpha
+            row_alpha[0] = _pdep_u64(row_pixels,       0x00FF00FF00FF00FFULL) | 0xFF00FF00FF00FF00ULL;
+            row_alpha[1] = _pdep_u64(row_pixels >> 32, 0x00FF00FF00FF00FFULL) | 0xFF00FF00FF00FF00ULL;
+            memcpy(p_row, row_alpha, sizeof(row_alpha));
+        }
+        else
+            memcpy(p_row, &row_pixels, sizeof(row_pixels));
+    }
+}
+
+
+__attribute__((target(BMI2_TARGET)))
+unsigned int romimg_packed_encode_tile_bmi2(const unsigned char * p_image_pixel, const rom_packed_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    uint64_t              row_fields, row_pixels, row_alpha[2], field_mask;
+    const unsigned char * p_row;
+    unsigned int          transparency_flag;
+    long int              image_stride;
+    int ty;
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+    field_mask   = 0x0101010101010101ULL * ((1U << p_layout->BITS_PER_PIXEL) - 1);
+
+    for (ty=0; ty < ROM_PACKED_TILE_HEIGHT; ty++) {
+
+        p_row = p_image_pixel + (ty * image_stride);
+
+        if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+            memcpy(row_alpha, p_row, sizeof(row_alpha));
+            row_pixels = romimg_bmi2_strip_alpha(row_alpha, &transparency_flag);
+        }
+        else
+            memcpy(&row_pixels, p_row, sizeof(row_pixels));
+
+        row_fields = _pext_u64(bmi2_reorder_pixels(row_pixels, p_layout), field_mask);
+        bmi2_store_row(p_tile + (ty * p_layout->BITS_PER_PIXEL), row_fields, p_layout->BITS_PER_PIXEL);
+    }
+
+    return transparency_flag;
+}
+
+
+
+// SSE2 / AVX2 tile decode / encode
+//
+// Decoding splits the bit fields of every byte with shifts and masks (two
+// nibbles for 4bpp, four 2 bit fields for 2bpp) and interleaves them back in
+// pixel order with byte / word unpacks, the pixel order inside a byte just
+// being the order of the unpack operands. Encoding masks each pixel down to
+// its bits and ORs neighbouring pixels together with shifts inside 16 / 32
+// bit lanes, then packs the lanes down to bytes.
+//
+// Formats storing the bytes of a row in reverse (NGPC) get their bytes
+// reordered with word shuffles (SSE2) or pshufb (AVX2) on the way in / out.
+//
+// Only 2, 4 and 8 bpp layouts are vectorized, anything else uses the scalar code.
+
+
+// Reverse the byte order within each group of N bytes (1, 2, 4 or 8)
+__attribute__((target("sse2")))
+static inline __m128i sse2_reverse_byte_groups(__m128i x, int group_bytes)
+{
+    if (group_bytes == 8)
+        x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x1B), 0x1B);
+    else if (group_bytes == 4)
+        x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+
+    if (group_bytes >= 2)
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+
+    return x;
+}
+
+
+// Split the 2 bit fields of each byte: *p_fields[N] = bits (2N + 1 .. 2N), swapped
+// around for the MS pixel first formats so *p_fields[0] is always the leftmost pixel
+__attribute__((target("sse2")))
+static inline void sse2_split_2bpp_fields(__m128i x, const rom_packed_layout * p_layout, __m128i * p_fields)
+{
+    __m128i field_mask;
+    int f;
+
+    field_mask = _mm_set1_epi8(0x03);
+
+    for (f=0; f < 4; f++)
+        p_fields[ (p_layout->MS_PIXEL_FIRST) ? (3 - f) : f ] = _mm_and_si128(_mm_srli_epi16(x, f * 2), field_mask);
+}
+
+
+// Pack the pixels (2 bits each) of 4 byte groups into one byte in the low byte of each 32 bit lane
+__attribute__((target("sse2")))
+static inline __m128i sse2_pack_2bpp_lanes(__m128i rows, const rom_packed_layout * p_layout)
+{
+    rows = _mm_and_si128(rows, _mm_set1_epi8(0x03));
+
+    if (p_layout->MS_PIXEL_FIRST) {
+        rows = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(rows, 2), _mm_srli_epi16(rows, 8)), _mm_set1_epi16(0x000F));
+        rows = _mm_or_si128(_mm_slli_epi32(rows, 4), _mm_srli_epi32(rows, 16));
+    }
+    else {
+        rows = _mm_and_si128(_mm_or_si128(rows, _mm_srli_epi16(rows, 6)), _mm_set1_epi16(0x000F));
+        rows = _mm_or_si128(rows, _mm_srli_epi32(rows, 12));
+    }
+
+    return _mm_and_si128(rows, _mm_set1_epi32(0x000000FF));
+}
+
+
+// Pack the pixels (4 bits each) of 2 byte groups into one byte in the low byte of each 16 bit lane
+__attribute__((target("sse2")))
+static inline __m128i sse2_pack_4bpp_lanes(__m128i rows, const rom_packed_layout * p_layout)
+{
+    rows = _mm_and_si128(rows, _mm_set1_epi8(0x0F));
+
+    if (p_layout->MS_PIXEL_FIRST)
+        rows = _mm_or_si128(_mm_slli_epi16(rows, 4), _mm_srli_epi16(rows, 8));
+    else
+        rows = _mm_or_si128(rows, _mm_srli_epi16(rows, 4));
+
+    return _mm_and_si128(rows, _mm_set1_epi16(0x00FF));
+}
+
+
+
+// Two tile rows per register: rows[0] = rows 0 & 1, ... rows[3] = rows 6 & 7
+__attribute__((target("sse2")))
+void romimg_packed_decode_tile_sse2(const unsigned char * p_tile, const rom_packed_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    __m128i  rows[4], fields[4];
+    __m128i  x, lo, hi, nibble_mask;
+    long int image_stride;
+    int r;
+
+    switch (p_layout->BITS_PER_PIXEL) {
+
+        case 8:
+            for (r=0; r < 4; r++) {
+                x = _mm_loadu_si128((const __m128i *)(p_tile + (r * 16)));
+                rows[r] = (p_layout->BYTES_REVERSED) ? sse2_reverse_byte_groups(x, 8) : x;
+            }
+            break;
+
+        case 4:
+            nibble_mask = _mm_set1_epi8(0x0F);
+
+            // 4 tile rows per 16 bytes
+            for (r=0; r < 4; r += 2) {
+                x = _mm_loadu_si128((const __m128i *)(p_tile + (r * 8)));
+                if (p_layout->BYTES_REVERSED)
+                    x = sse2_reverse_byte_groups(x, 4);
+
+                lo = _mm_and_si128(x, nibble_mask);
+                hi = _mm_and_si128(_mm_srli_epi16(x, 4), nibble_mask);
+
+                if (p_layout->MS_PIXEL_FIRST) {
+                    rows[r]     = _mm_unpacklo_epi8(hi, lo);
+                    rows[r + 1] = _mm_unpackhi_epi8(hi, lo);
+                }
+                else {
+                    rows[r]     = _mm_unpacklo_epi8(lo, hi);
+                    rows[r + 1] = _mm_unpackhi_epi8(lo, hi);
+                }
+            }
+            break;
+
+        case 2:
+            // The whole tile fits in 16 bytes
+            x = _mm_loadu_si128((const __m128i *)(p_tile));
+            if (p_layout->BYTES_REVERSED)
+                x = sse2_reverse_byte_groups(x, 2);
+
+            sse2_split_2bpp_fields(x, p_layout, fields);
+
+            lo = _mm_unpacklo_epi8(fields[0], fields[1]);
+            hi = _mm_unpacklo_epi8(fields[2], fields[3]);
+            rows[0] = _mm_unpacklo_epi16(lo, hi);
+            rows[1] = _mm_unpackhi_epi16(lo, hi);
+
+            lo = _mm_unpackhi_epi8(fields[0], fields[1]);
+            hi = _mm_unpackhi_epi8(fields[2], fields[3]);
+            rows[2] = _mm_unpacklo_epi16(lo, hi);
+            rows[3] = _mm_unpackhi_epi16(lo, hi);
+            break;
+
+        default:
+            romimg_packed_decode_tile_scalar(p_tile, p_layout, p_image_pixel, p_app_gfx);
+            return;
+    }
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    for (r=0; r < 4; r++)
+        sse2_store_rows(p_image_pixel + (r * 2 * image_stride), image_stride, rows[r], p_app_gfx);
+}
+
+
+__attribute__((target("sse2")))
+unsigned int romimg_packed_encode_tile_sse2(const unsigned char * p_image_pixel, const rom_packed_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    __m128i      rows[4], x;
+    unsigned int transparency_flag;
+    long int     image_stride;
+    int r;
+
+    if ((p_layout->BITS_PER_PIXEL != 8) &&
+        (p_layout->BITS_PER_PIXEL != 4) &&
+        (p_layout->BITS_PER_PIXEL != 2))
+        return romimg_packed_encode_tile_scalar(p_image_pixel, p_layout, p_tile, p_app_gfx);
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    for (r=0; r < 4; r++)
+        rows[r] = sse2_load_rows(p_image_pixel + (r * 2 * image_stride), image_stride, &transparency_flag, p_app_gfx);
+
+    switch (p_layout->BITS_PER_PIXEL) {
+
+        case 8:
+            for (r=0; r < 4; r++) {
+                x = (p_layout->BYTES_REVERSED) ? sse2_reverse_byte_groups(rows[r], 8) : rows[r];
+                _mm_storeu_si128((__m128i *)(p_tile + (r * 16)), x);
+            }
+            break;
+
+        case 4:
+            // 4 tile rows per 16 bytes
+            for (r=0; r < 4; r += 2) {
+                x = _mm_packus_epi16(sse2_pack_4bpp_lanes(rows[r], p_layout),
+                                     sse2_pack_4bpp_lanes(rows[r + 1], p_layout));
+                if (p_layout->BYTES_REVERSED)
+                    x = sse2_reverse_byte_groups(x, 4);
+
+                _mm_storeu_si128((__m128i *)(p_tile + (r * 8)), x);
+            }
+            break;
+
+        case 2:
+            // The whole tile fits in 16 bytes
+            x = _mm_packus_epi16(_mm_packs_epi32(sse2_pack_2bpp_lanes(rows[0], p_layout),
+                                                 sse2_pack_2bpp_lanes(rows[1], p_layout)),
+                                 _mm_packs_epi32(sse2_pack_2bpp_lanes(rows[2], p_layout),
+                                                 sse2_pack_2bpp_lanes(rows[3], p_layout)));
+            if (p_layout->BYTES_REVERSED)
+                x = sse2_reverse_byte_groups(x, 2);
+
+            _mm_storeu_si128((__m128i *)(p_tile), x);
+            break;
+    }
+
+    return transparency_flag;
+}
+
+
+
+// pshufb indexes which reverse the byte order within each group of N bytes
+__attribute__((target("avx2")))
+static inline __m256i avx2_reverse_byte_groups(__m256i x, int group_bytes)
+{
+    switch (group_bytes) {
+        case 8:
+            return _mm256_shuffle_epi8(x, _mm256_setr_epi8(7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8,
+                                                           7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8));
+        case 4:
+            return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+                                                           3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12));
+        case 2:
+            return _mm256_shuffle_epi8(x, _mm256_setr_epi8(1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14,
+                                                           1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14));
+        default:
+            return x;
+    }
+}
+
+
+// Four tile rows per register: rows 0-3 and rows 4-7
+__attribute__((target("avx2")))
+void romimg_packed_decode_tile_avx2(const unsigned char * p_tile, const rom_packed_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    __m256i  rows_0_3, rows_4_7, rows_a, rows_b;
+    __m256i  x, lo, hi, nibble_mask, field_mask;
+    __m256i  fields[4];
+    long int image_stride;
+    int f;
+
+    switch (p_layout->BITS_PER_PIXEL) {
+
+        case 8:
+            rows_0_3 = _mm256_loadu_si256((const __m256i *)(p_tile));
+            rows_4_7 = _mm256_loadu_si256((const __m256i *)(p_tile + 32));
+
+            if (p_layout->BYTES_REVERSED) {
+                rows_0_3 = avx2_reverse_byte_groups(rows_0_3, 8);
+                rows_4_7 = avx2_reverse_byte_groups(rows_4_7, 8);
+            }
+            break;
+
+        case 4:
+            // The whole tile fits in 32 bytes
+            x = _mm256_loadu_si256((const __m256i *)(p_tile));
+            if (p_layout->BYTES_REVERSED)
+                x = avx2_reverse_byte_groups(x, 4);
+
+            nibble_mask = _mm256_set1_epi8(0x0F);
+            lo = _mm256_and_si256(x, nibble_mask);
+            hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble_mask);
+
+            // rows_a = rows 0, 1 | rows 4, 5   rows_b = rows 2, 3 | rows 6, 7
+            if (p_layout->MS_PIXEL_FIRST) {
+                rows_a = _mm256_unpacklo_epi8(hi, lo);
+                rows_b = _mm256_unpackhi_epi8(hi, lo);
+            }
+            else {
+                rows_a = _mm256_unpacklo_epi8(lo, hi);
+                rows_b = _mm256_unpackhi_epi8(lo, hi);
+            }
+
+            rows_0_3 = _mm256_permute2x128_si256(rows_a, rows_b, 0x20);
+            rows_4_7 = _mm256_permute2x128_si256(rows_a, rows_b, 0x31);
+            break;
+
+        case 2:
+            // Rows 0-3 in the low half of the first lane, rows 4-7 in the low half of the second
+            x = _mm256_permute4x64_epi64(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p_tile))), 0x10);
+            if (p_layout->BYTES_REVERSED)
+                x = avx2_reverse_byte_groups(x, 2);
+
+            field_mask = _mm256_set1_epi8(0x03);
+            for (f=0; f < 4; f++)
+                fields[ (p_layout->MS_PIXEL_FIRST) ? (3 - f) : f ] = _mm256_and_si256(_mm256_srli_epi16(x, f * 2), field_mask);
+
+            lo = _mm256_unpacklo_epi8(fields[0], fields[1]);
+            hi = _mm256_unpacklo_epi8(fields[2], fields[3]);
+
+            // rows_a = rows 0, 1 | rows 4, 5   rows_b = rows 2, 3 | rows 6, 7
+            rows_a = _mm256_unpacklo_epi16(lo, hi);
+            rows_b = _mm256_unpackhi_epi16(lo, hi);
+
+            rows_0_3 = _mm256_permute2x128_si256(rows_a, rows_b, 0x20);
+            rows_4_7 = _mm256_permute2x128_si256(rows_a, rows_b, 0x31);
+            break;
+
+        default:
+            romimg_packed_decode_tile_scalar(p_tile, p_layout, p_image_pixel, p_app_gfx);
+            return;
+    }
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    avx2_store_rows(p_image_pixel,                    image_stride, rows_0_3, p_app_gfx);
+    avx2_store_rows(p_image_pixel + image_stride * 4, image_stride, rows_4_7, p_app_gfx);
+
+    // Avoid AVX <-> SSE transition stalls in the (non-VEX) calling code
+    _mm256_zeroupper();
+}
+
+
+// Pack the pixels (4 bits each) of 2 byte groups into one byte in the low byte of each 16 bit lane
+__attribute__((target("avx2")))
+static inline __m256i avx2_pack_4bpp_lanes(__m256i rows, const rom_packed_layout * p_layout)
+{
+    rows = _mm256_and_si256(rows, _mm256_set1_epi8(0x0F));
+
+    if (p_layout->MS_PIXEL_FIRST)
+        rows = _mm256_or_si256(_mm256_slli_epi16(rows, 4), _mm256_srli_epi16(rows, 8));
+    else
+        rows = _mm256_or_si256(rows, _mm256_srli_epi16(rows, 4));
+
+    return _mm256_and_si256(rows, _mm256_set1_epi16(0x00FF));
+}
+
+
+// Pack the pixels (2 bits each) of 4 byte groups into one byte in the low byte of each 32 bit lane
+__attribute__((target("avx2")))
+static inline __m256i avx2_pack_2bpp_lanes(__m256i rows, const rom_packed_layout * p_layout)
+{
+    rows = _mm256_and_si256(rows, _mm256_set1_epi8(0x03));
+
+    if (p_layout->MS_PIXEL_FIRST) {
+        rows = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(rows, 2), _mm256_srli_epi16(rows, 8)), _mm256_set1_epi16(0x000F));
+        rows = _mm256_or_si256(_mm256_slli_epi32(rows, 4), _mm256_srli_epi32(rows, 16));
+    }
+    else {
+        rows = _mm256_and_si256(_mm256_or_si256(rows, _mm256_srli_epi16(rows, 6)), _mm256_set1_epi16(0x000F));
+        rows = _mm256_or_si256(rows, _mm256_srli_epi32(rows, 12));
+    }
+
+    return _mm256_and_si256(rows, _mm256_set1_epi32(0x000000FF));
+}
+
+
+__attribute__((target("avx2")))
+unsigned int romimg_packed_encode_tile_avx2(const unsigned char * p_image_pixel, const rom_packed_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    __m256i      rows_0_3, rows_4_7, x;
+    __m128i      x_128;
+    unsigned int transparency_flag;
+    long int     image_stride;
+
+    if ((p_layout->BITS_PER_PIXEL != 8) &&
+        (p_layout->BITS_PER_PIXEL != 4) &&
+        (p_layout->BITS_PER_PIXEL != 2))
+        return romimg_packed_encode_tile_scalar(p_image_pixel, p_layout, p_tile, p_app_gfx);
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    rows_0_3 = avx2_load_rows(p_image_pixel,                    image_stride, &transparency_flag, p_app_gfx);
+    rows_4_7 = avx2_load_rows(p_image_pixel + image_stride * 4, image_stride, &transparency_flag, p_app_gfx);
+
+    switch (p_layout->BITS_PER_PIXEL) {
+
+        case 8:
+            if (p_layout->BYTES_REVERSED) {
+                rows_0_3 = avx2_reverse_byte_groups(rows_0_3, 8);
+                rows_4_7 = avx2_reverse_byte_groups(rows_4_7, 8);
+            }
+
+            _mm256_storeu_si256((__m256i *)(p_tile),      rows_0_3);
+            _mm256_storeu_si256((__m256i *)(p_tile + 32), rows_4_7);
+            break;
+
+        case 4:
+            // Packing gives rows 0, 1, 4, 5 | rows 2, 3, 6, 7, put them back in order
+            x = _mm256_packus_epi16(avx2_pack_4bpp_lanes(rows_0_3, p_layout),
+                                    avx2_pack_4bpp_lanes(rows_4_7, p_layout));
+            x = _mm256_permute4x64_epi64(x, 0xD8);
+
+            if (p_layout->BYTES_REVERSED)
+                x = avx2_reverse_byte_groups(x, 4);
+
+            _mm256_storeu_si256((__m256i *)(p_tile), x);
+            break;
+
+        case 2:
+            // Packing gives rows 0, 1, 4, 5 | rows 2, 3, 6, 7 in the low 8 bytes of each lane
+            x = _mm256_packs_epi32(avx2_pack_2bpp_lanes(rows_0_3, p_layout),
+                                   avx2_pack_2bpp_lanes(rows_4_7, p_layout));
+            x = _mm256_packus_epi16(x, x);
+
+            x_128 = _mm_unpacklo_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+            if (p_layout->BYTES_REVERSED)
+                x_128 = _mm256_castsi256_si128(avx2_reverse_byte_groups(_mm256_castsi128_si256(x_128), 2));
+
+            _mm_storeu_si128((__m128i *)(p_tile), x_128);
+            break;
+    }
+
+    // Avoid AVX <-> SSE transition stalls in the (non-VEX) calling code
+    _mm256_zeroupper();
+
+    return transparency_flag;
+}
+
+#endif // ROM_DISPATCH_X86
@@ -0,0 +1,392 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+// Rom patch output (IPS and BPS)
+//
+// Only the spliced part of the target (and whatever moved after it) can
+// differ from the source, so the diff starts there. Equal stretches are
+// skipped a block at a time with memcmp, then narrowed down per byte.
+
+#include "rom_patch.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Bytes compared at a time when skipping unchanged data
+#define ROM_PATCH_DIFF_BLOCK     64
+
+// IPS records address 24 bits, with a 16 bit size. A record can't start
+// at 0x454F46 since it reads as the "EOF" end marker
+#define IPS_MAX_OFFSET           0xFFFFFF
+#define IPS_MAX_RECORD_SIZE      0xFFFF
+#define IPS_EOF_OFFSET           0x454F46
+
+// Unchanged gaps up to this many bytes get included in the surrounding change,
+// they cost less than starting a new record (IPS: 5 byte header, BPS: 1-2 byte action)
+#define IPS_MERGE_GAP            5
+#define BPS_MERGE_GAP            1
+
+#define BPS_ACTION_SOURCE_READ   0
+#define BPS_ACTION_TARGET_READ   1
+
+
+// Output which keeps a running CRC-32 of everything written (for the BPS footer)
+typedef struct patch_writer {
+    FILE   * file;
+    uint32_t crc;
+    int      status;
+} patch_writer;
+
+
+static uint32_t crc32_table[256];
+static int      crc32_table_ready = 0;
+
+
+
+static uint32_t patch_crc32(uint32_t crc, const unsigned char * p_data, long int size)
+{
+    uint32_t c;
+    int      n, k;
+
+    if (!crc32_table_ready) {
+        for (n = 0; n < 256; n++) {
+            c = (uint32_t)n;
+            for (k = 0; k < 8; k++)
+                c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+            crc32_table[n] = c;
+        }
+        crc32_table_ready = 1;
+    }
+
+    crc = ~crc;
+    while (size-- > 0)
+        crc = crc32_table[(crc ^ *p_data++) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+
+
+static long int patch_target_size(rom_patch_target * p_target)
+{
+    return p_target->source_size - p_target->splice_length + p_target->splice_size;
+}
+
+
+// Returns the target bytes starting at pos, *p_run is set to how many
+// follow on contiguously (up to the next boundary of the splice)
+static const unsigned char * patch_target_bytes(rom_patch_target * p_target, long int pos, long int * p_run)
+{
+    long int splice_end = p_target->splice_offset + p_target->splice_size;
+
+    if (pos < p_target->splice_offset) {
+        *p_run = p_target->splice_offset - pos;
+        return p_target->p_source + pos;
+    }
+    else if (pos < splice_end) {
+        *p_run = splice_end - pos;
+        return p_target->p_splice + (pos - p_target->splice_offset);
+    }
+    else {
+        *p_run = patch_target_size(p_target) - pos;
+        return p_target->p_source + (pos - p_target->splice_size + p_target->splice_length);
+    }
+}
+
+
+// Returns the position of the next target byte at or after pos which isn't the same
+// as the source byte there (past the end of the source every byte counts as changed),
+// or the target size if there are none
+static long int patch_next_change(rom_patch_target * p_target, long int pos)
+{
+    const unsigned char * p_bytes;
+    const unsigned char * p_source;
+    long int compare_end, run, k;
+
+    // Nothing before the splice changes
+    if (pos < p_target->splice_offset)
+        pos = p_target->splice_offset;
+
+    compare_end = patch_target_size(p_target);
+    if (compare_end > p_target->source_size)
+        compare_end = p_target->source_size;
+
+    while (pos < compare_end) {
+
+        p_bytes  = patch_target_bytes(p_target, pos, &run);
+        p_source = p_target->p_source + pos;
+
+        if (run > (compare_end - pos))
+            run = compare_end - pos;
+
+        // The bytes after a splice that doesn't change the size are the source itself
+        if (p_bytes != p_source) {
+
+            for (k = 0; ((k + ROM_PATCH_DIFF_BLOCK) <= run) &&
+                        (0 == memcmp(p_bytes + k, p_source + k, ROM_PATCH_DIFF_BLOCK)); k += ROM_PATCH_DIFF_BLOCK)
+                ;
+            for (; (k < run) && (p_bytes[k] == p_source[k]); k++)
+                ;
+
+            if (k < run)
+                return pos + k;
+        }
+
+        pos += run;
+    }
+
+    // Past the end of the source every byte is a change
+    return (pos < patch_target_size(p_target)) ? pos : patch_target_size(p_target);
+}
+
+
+// Returns the end of the changed bytes starting at pos, including
+// unchanged gaps of up to merge_gap bytes between changes
+static long int patch_change_end(rom_patch_target * p_target, long int pos, long int merge_gap)
+{
+    const unsigned char * p_bytes;
+    long int target_size, run, k, next;
+
+    target_size = patch_target_size(p_target);
+
+    while (pos < target_size) {
+
+        // Everything past the end of the source is new
+        if (pos >= p_target->source_size)
+            return target_size;
+
+        p_bytes = patch_target_bytes(p_target, pos, &run);
+
+        if (run > (p_target->source_size - pos))
+            run = p_target->source_size - pos;
+
+        for (k = 0; (k < run) && (p_bytes[k] != p_target->p_source[pos + k]); k++)
+            ;
+        pos += k;
+
+        if (k < run) {
+            // Reached unchanged bytes, keep going if they're only a short gap
+            next = patch_next_change(p_target, pos);
+            if ((next >= target_size) || ((next - pos) > merge_gap))
+                return pos;
+            pos = next;
+        }
+    }
+
+    return target_size;
+}
+
+
+static void patch_write(patch_writer * p_writer, const void * p_data, long int size)
+{
+    if ((0 == p_writer->status) && (size > 0)) {
+        if (1 != fwrite(p_data, size, 1, p_writer->file))
+            p_writer->status = -1;
+        p_writer->crc = patch_crc32(p_writer->crc, p_data, size);
+    }
+}
+
+
+static void patch_write_target(patch_writer * p_writer, rom_patch_target * p_target, long int pos, long int end)
+{
+    const unsigned char * p_bytes;
+    long int run;
+
+    while (pos < end) {
+        p_bytes = patch_target_bytes(p_target, pos, &run);
+        if (run > (end - pos))
+            run = end - pos;
+
+        patch_write(p_writer, p_bytes, run);
+        pos += run;
+    }
+}
+
+
+static void patch_write_be(patch_writer * p_writer, uint32_t value, int bytes)
+{
+    unsigned char buf[4];
+    int n;
+
+    for (n = 0; n < bytes; n++)
+        buf[n] = (unsigned char)(value >> (8 * (bytes - 1 - n)));
+
+    patch_write(p_writer, buf, bytes);
+}
+
+
+static void patch_write_le32(patch_writer * p_writer, uint32_t value)
+{
+    unsigned char buf[4];
+    int n;
+
+    for (n = 0; n < 4; n++)
+        buf[n] = (unsigned char)(value >> (8 * n));
+
+    patch_write(p_writer, buf, 4);
+}
+
+
+// BPS variable length number: 7 bits per byte, last byte flagged with the top bit
+static void patch_write_bps_number(patch_writer * p_writer, uint64_t value)
+{
+    unsigned char byte;
+
+    for (;;) {
+        byte   = value & 0x7F;
+        value >>= 7;
+
+        if (0 == value) {
+            byte |= 0x80;
+            patch_write(p_writer, &byte, 1);
+            break;
+        }
+
+        patch_write(p_writer, &byte, 1);
+        value--;
+    }
+}
+
+
+
+// IPS: "PATCH", then records of 3 byte offset, 2 byte size and data, then "EOF".
+// If the target is smaller than the source its 3 byte size follows (truncate extension)
+static int patch_write_ips(patch_writer * p_writer, rom_patch_target * p_target)
+{
+    long int target_size, pos, end, record_size;
+
+    target_size = patch_target_size(p_target);
+
+    patch_write(p_writer, "PATCH", 5);
+
+    pos = patch_next_change(p_target, 0);
+
+    while (pos < target_size) {
+
+        end = patch_change_end(p_target, pos, IPS_MERGE_GAP);
+
+        while (pos < end) {
+
+            // Back up a byte (rewriting it as it is) rather than start at "EOF"
+            if (IPS_EOF_OFFSET == pos)
+                pos--;
+
+            if (pos > IPS_MAX_OFFSET) {
+                printf("IPS patch: change at 0x%lX is past 16 MiB, IPS can't reach it. Use BPS instead\n", pos);
+                return -1;
+            }
+
+            record_size = end - pos;
+            if (record_size > IPS_MAX_RECORD_SIZE)
+                record_size = IPS_MAX_RECORD_SIZE;
+
+            patch_write_be(p_writer, (uint32_t)pos, 3);
+            patch_write_be(p_writer, (uint32_t)record_size, 2);
+            patch_write_target(p_writer, p_target, pos, pos + record_size);
+
+            pos += record_size;
+        }
+
+        pos = patch_next_change(p_target, end);
+    }
+
+    patch_write(p_writer, "EOF", 3);
+
+    if (target_size < p_target->source_size) {
+        if (target_size > IPS_MAX_OFFSET) {
+            printf("IPS patch: can't truncate to %ld bytes, past 16 MiB. Use BPS instead\n", target_size);
+            return -1;
+        }
+        patch_write_be(p_writer, (uint32_t)target_size, 3);
+    }
+
+    return p_writer->status;
+}
+
+
+
+// BPS: "BPS1", source / target / metadata sizes, then actions copying runs of
+// source bytes (at the same position) or new target bytes, then the CRC-32s
+// of the source, the target and the patch itself
+static int patch_write_bps(patch_writer * p_writer, rom_patch_target * p_target)
+{
+    long int target_size, pos, next, end, run;
+    const unsigned char * p_bytes;
+    uint32_t target_crc;
+
+    target_size = patch_target_size(p_target);
+
+    patch_write(p_writer, "BPS1", 4);
+    patch_write_bps_number(p_writer, p_target->source_size);
+    patch_write_bps_number(p_writer, target_size);
+    patch_write_bps_number(p_writer, 0); // no metadata
+
+    pos = 0;
+
+    while (pos < target_size) {
+
+        // Unchanged bytes come from the source
+        next = patch_next_change(p_target, pos);
+        if (next > pos)
+            patch_write_bps_number(p_writer, ((uint64_t)(next - pos - 1) << 2) | BPS_ACTION_SOURCE_READ);
+
+        if (next >= target_size)
+            break;
+
+        // Changed ones are in the patch
+        end = patch_change_end(p_target, next, BPS_MERGE_GAP);
+        patch_write_bps_number(p_writer, ((uint64_t)(end - next - 1) << 2) | BPS_ACTION_TARGET_READ);
+        patch_write_target(p_writer, p_target, next, end);
+
+        pos = end;
+    }
+
+    target_crc = 0;
+    for (pos = 0; pos < target_size; pos += run) {
+        p_bytes    = patch_target_bytes(p_target, pos, &run);
+        target_crc = patch_crc32(target_crc, p_bytes, run);
+    }
+
+    patch_write_le32(p_writer, patch_crc32(0, p_target->p_source, p_target->source_size));
+    patch_write_le32(p_writer, target_crc);
+    patch_write_le32(p_writer, p_writer->crc);
+
+    return p_writer->status;
+}
+
+
+
+// Writes a patch in patch_format (IPS or BPS) that turns the source into the target
+int romimg_patch_write(FILE * file, int patch_format, rom_patch_target * p_target)
+{
+    patch_writer writer;
+
+    if ((p_target->splice_offset < 0) || (p_target->splice_length < 0) ||
+        ((p_target->splice_offset + p_target->splice_length) > p_target->source_size))
+        return -1;
+
+    writer.file   = file;
+    writer.crc    = 0;
+    writer.status = 0;
+
+    switch (patch_format) {
+        case ROM_PATCH_IPS: return patch_write_ips(&writer, p_target);
+        case ROM_PATCH_BPS: return patch_write_bps(&writer, p_target);
+        default:            return -1;
+    }
+}
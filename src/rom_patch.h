@@ -2,8 +2,6 @@
               ROM bin load / save plugin for the GIMP
                  Copyright 2018 - X
 
-                 Useful : https://www.rpi.edu/dept/acm/packages/gimp/gimp-1.2.3/plug-ins/common/pcx.c
-
  This program is free software: you can redistribute it and/or modify
  it under the terms of the GNU General Public License as published by
  the Free Software Foundation, either version 3 of the License, or
@@ -19,5 +17,29 @@
 =======================================================================*/
 
 
-int bin_decode_nes_2bpp(rom_gfx_data *, app_gfx_data *, app_color_data *);
-int bin_encode_nes_2bpp(rom_gfx_data *, app_gfx_data *);
\ No newline at end of file
+#ifndef ROM_PATCH_FILE_HEADER
+#define ROM_PATCH_FILE_HEADER
+
+#include <stdio.h>
+
+    enum rom_patch_formats {
+        ROM_PATCH_IPS,
+        ROM_PATCH_BPS,
+        ROM_PATCH_LAST
+    };
+
+    // The patched rom: the source with splice_length bytes at splice_offset
+    // replaced by the splice_size bytes of p_splice (so it can grow or shrink)
+    typedef struct rom_patch_target {
+        const unsigned char * p_source;
+        long int              source_size;
+
+        long int              splice_offset;
+        long int              splice_length;
+        const unsigned char * p_splice;
+        long int              splice_size;
+    } rom_patch_target;
+
+    int romimg_patch_write(FILE *, int, rom_patch_target *);
+
+#endif // ROM_PATCH_FILE_HEADER
@@ -0,0 +1,342 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#include "rom_planar.h"
+#include "rom_utils.h"
+#include "rom_portable.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+// Tile kernels for each codec level, NULL if there isn't one
+static const romimg_planar_decode_tile_fn planar_decoders[ROMIMG_CPU_LEVEL_COUNT] = {
+        [ROMIMG_CPU_LEVEL_SCALAR] = romimg_planar_decode_tile_scalar,
+        [ROMIMG_CPU_LEVEL_SWAR]   = romimg_planar_decode_tile_swar,
+#ifdef ROM_DISPATCH_X86
+        [ROMIMG_CPU_LEVEL_BMI2]   = romimg_planar_decode_tile_bmi2,
+        [ROMIMG_CPU_LEVEL_SSE2]   = romimg_planar_decode_tile_sse2,
+        [ROMIMG_CPU_LEVEL_AVX2]   = romimg_planar_decode_tile_avx2,
+        [ROMIMG_CPU_LEVEL_GFNI]   = romimg_planar_decode_tile_gfni,
+#endif
+};
+
+static const romimg_planar_encode_tile_fn planar_encoders[ROMIMG_CPU_LEVEL_COUNT] = {
+        [ROMIMG_CPU_LEVEL_SCALAR] = romimg_planar_encode_tile_scalar,
+        [ROMIMG_CPU_LEVEL_SWAR]   = romimg_planar_encode_tile_swar,
+#ifdef ROM_DISPATCH_X86
+        [ROMIMG_CPU_LEVEL_BMI2]   = romimg_planar_encode_tile_bmi2,
+        [ROMIMG_CPU_LEVEL_SSE2]   = romimg_planar_encode_tile_sse2,
+        [ROMIMG_CPU_LEVEL_AVX2]   = romimg_planar_encode_tile_avx2,
+        [ROMIMG_CPU_LEVEL_GFNI]   = romimg_planar_encode_tile_gfni,
+#endif
+};
+
+
+
+// Fill in the derived permutation tables of a layout (only done once)
+//
+// These let the GFNI kernels move a whole tile between rom order and
+// row-major order with a single byte permute in each direction
+static void planar_prepare_layout(rom_planar_layout * p_layout)
+{
+    int p, ty, tile_byte, row_major_byte;
+
+    if (p_layout->PREPARED)
+        return;
+
+    p_layout->TILE_BYTES      = 0;
+    p_layout->ROW_MAJOR_MASK  = 0;
+    p_layout->TILE_ORDER_MASK = 0;
+    memset(p_layout->ROW_MAJOR_INDEX,  0, sizeof(p_layout->ROW_MAJOR_INDEX));
+    memset(p_layout->TILE_ORDER_INDEX, 0, sizeof(p_layout->TILE_ORDER_INDEX));
+
+    for (p=0; p < p_layout->BITPLANES; p++) {
+        for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++) {
+
+            tile_byte = p_layout->PLANE_OFFSET[p] + (ty * p_layout->PLANE_ROW_INCREMENT[p]);
+
+            // Decode side: bitplanes in reverse order, as expected by the GF(2) affine transform
+            row_major_byte = (ty * ROM_PLANAR_MAX_PLANES) + (ROM_PLANAR_MAX_PLANES - 1 - p);
+            p_layout->ROW_MAJOR_INDEX[row_major_byte] = (unsigned char)tile_byte;
+            p_layout->ROW_MAJOR_MASK |= 1ULL << row_major_byte;
+
+            // Encode side: bitplanes in natural order
+            row_major_byte = (ty * ROM_PLANAR_MAX_PLANES) + p;
+            p_layout->TILE_ORDER_INDEX[tile_byte] = (unsigned char)row_major_byte;
+            p_layout->TILE_ORDER_MASK |= 1ULL << tile_byte;
+
+            if (tile_byte >= p_layout->TILE_BYTES)
+                p_layout->TILE_BYTES = (unsigned char)(tile_byte + 1);
+        }
+    }
+
+    p_layout->PREPARED = 1;
+}
+
+
+
+// Tile kernels of a codec level for the layout: layouts with their own
+// constant-layout portable kernels use those in place of the generic SWAR kernels
+static romimg_planar_decode_tile_fn planar_level_decoder(const rom_planar_layout * p_layout, int level)
+{
+    if ((ROMIMG_CPU_LEVEL_SWAR == level) && (NULL != p_layout->PORTABLE_DECODE_TILE))
+        return p_layout->PORTABLE_DECODE_TILE;
+
+    return planar_decoders[level];
+}
+
+
+static romimg_planar_encode_tile_fn planar_level_encoder(const rom_planar_layout * p_layout, int level)
+{
+    if ((ROMIMG_CPU_LEVEL_SWAR == level) && (NULL != p_layout->PORTABLE_ENCODE_TILE))
+        return p_layout->PORTABLE_ENCODE_TILE;
+
+    return planar_encoders[level];
+}
+
+
+
+// Self-check: decode a test tile at the given level and compare with the scalar decoder
+static int planar_check_decoder(int level, const void * p_ctx)
+{
+    const rom_planar_layout * p_layout = p_ctx;
+    unsigned char tile[ROM_PLANAR_MAX_TILE_BYTES];
+    unsigned char image_ref[ROM_PLANAR_TILE_WIDTH * ROM_PLANAR_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    unsigned char image_test[ROM_PLANAR_TILE_WIDTH * ROM_PLANAR_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    app_gfx_data  app_gfx;
+
+    if ((NULL == planar_level_decoder(p_layout, level)) || !romimg_cpu_level_supported(level))
+        return 0;
+
+    romimg_dispatch_fill_test_pattern(tile, sizeof(tile), 1);
+
+    app_gfx.width  = ROM_PLANAR_TILE_WIDTH;
+    app_gfx.height = ROM_PLANAR_TILE_HEIGHT;
+
+    for (app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED;
+         app_gfx.bytes_per_pixel <= BIN_BITDEPTH_INDEXED_ALPHA;
+         app_gfx.bytes_per_pixel++) {
+
+        memset(image_ref,  0, sizeof(image_ref));
+        memset(image_test, 0, sizeof(image_test));
+
+        romimg_planar_decode_tile_scalar(tile, p_layout, image_ref, &app_gfx);
+        planar_level_decoder(p_layout, level)(tile, p_layout, image_test, &app_gfx);
+
+        if (0 != memcmp(image_ref, image_test, sizeof(image_ref))) {
+            printf("Planar tile decoder self-check failed: %s\n", romimg_cpu_level_name(level));
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+// Self-check: encode a test image at the given level and compare with the scalar encoder
+static int planar_check_encoder(int level, const void * p_ctx)
+{
+    const rom_planar_layout * p_layout = p_ctx;
+    unsigned char image[ROM_PLANAR_TILE_WIDTH * ROM_PLANAR_TILE_HEIGHT * BIN_BITDEPTH_INDEXED_ALPHA];
+    unsigned char tile_ref[ROM_PLANAR_MAX_TILE_BYTES];
+    unsigned char tile_test[ROM_PLANAR_MAX_TILE_BYTES];
+    app_gfx_data  app_gfx;
+    unsigned int  transparent_ref, transparent_test;
+    int c;
+
+    if ((NULL == planar_level_encoder(p_layout, level)) || !romimg_cpu_level_supported(level))
+        return 0;
+
+    // Pixel indexes with all bits in use, about half of them transparent
+    romimg_dispatch_fill_test_pattern(image, sizeof(image), 2);
+    for (c=1; c < (int)sizeof(image); c += 2)
+        image[c] = (image[c] & 0x01) ? 0xFF : 0x00;
+
+    app_gfx.width  = ROM_PLANAR_TILE_WIDTH;
+    app_gfx.height = ROM_PLANAR_TILE_HEIGHT;
+
+    for (app_gfx.bytes_per_pixel = BIN_BITDEPTH_INDEXED;
+         app_gfx.bytes_per_pixel <= BIN_BITDEPTH_INDEXED_ALPHA;
+         app_gfx.bytes_per_pixel++) {
+
+        memset(tile_ref,  0, sizeof(tile_ref));
+        memset(tile_test, 0, sizeof(tile_test));
+
+        transparent_ref  = romimg_planar_encode_tile_scalar(image, p_layout, tile_ref, &app_gfx);
+        transparent_test = planar_level_encoder(p_layout, level)(image, p_layout, tile_test, &app_gfx);
+
+        if ((transparent_ref != transparent_test) ||
+            (0 != memcmp(tile_ref, tile_test, sizeof(tile_ref)))) {
+            printf("Planar tile encoder self-check failed: %s\n", romimg_cpu_level_name(level));
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+// Returns the fastest tile decoder for the layout which the running CPU supports
+// (and which decodes identically to the scalar decoder)
+romimg_planar_decode_tile_fn romimg_planar_get_tile_decoder(rom_planar_layout * p_layout)
+{
+    planar_prepare_layout(p_layout);
+
+    if (NULL == p_layout->DECODE_TILE)
+        p_layout->DECODE_TILE = planar_level_decoder(p_layout, romimg_dispatch_select_level(planar_check_decoder, p_layout));
+
+    return p_layout->DECODE_TILE;
+}
+
+
+// Returns the fastest tile encoder for the layout which the running CPU supports
+// (and which encodes identically to the scalar encoder)
+romimg_planar_encode_tile_fn romimg_planar_get_tile_encoder(rom_planar_layout * p_layout)
+{
+    planar_prepare_layout(p_layout);
+
+    if (NULL == p_layout->ENCODE_TILE)
+        p_layout->ENCODE_TILE = planar_level_encoder(p_layout, romimg_dispatch_select_level(planar_check_encoder, p_layout));
+
+    return p_layout->ENCODE_TILE;
+}
+
+
+
+// Copy the bitplanes of a tile into plane-major order:
+// p_planes[(P * 8) + N] = Row N of bitplane P
+void romimg_planar_gather_tile(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_planes)
+{
+    const unsigned char * p_plane;
+    int p, ty;
+
+    for (p=0; p < p_layout->BITPLANES; p++) {
+
+        p_plane = p_tile + p_layout->PLANE_OFFSET[p];
+
+        // Bitplane rows are often consecutive bytes (NES), copy them in one go
+        if (1 == p_layout->PLANE_ROW_INCREMENT[p])
+            memcpy(p_planes, p_plane, ROM_PLANAR_TILE_HEIGHT);
+        else {
+            for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++)
+                p_planes[ty] = *(p_plane + (ty * p_layout->PLANE_ROW_INCREMENT[p]));
+        }
+
+        p_planes += ROM_PLANAR_TILE_HEIGHT;
+    }
+}
+
+
+// Reverse of romimg_planar_gather_tile(): store plane-major bitplane rows into the tile
+void romimg_planar_scatter_tile(const unsigned char * p_planes, const rom_planar_layout * p_layout, unsigned char * p_tile)
+{
+    unsigned char * p_plane;
+    int p, ty;
+
+    for (p=0; p < p_layout->BITPLANES; p++) {
+
+        p_plane = p_tile + p_layout->PLANE_OFFSET[p];
+
+        if (1 == p_layout->PLANE_ROW_INCREMENT[p])
+            memcpy(p_plane, p_planes, ROM_PLANAR_TILE_HEIGHT);
+        else {
+            for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++)
+                *(p_plane + (ty * p_layout->PLANE_ROW_INCREMENT[p])) = p_planes[ty];
+        }
+
+        p_planes += ROM_PLANAR_TILE_HEIGHT;
+    }
+}
+
+
+
+void romimg_planar_decode_tile_scalar(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    uint64_t        row_pixels;
+    unsigned char * p_row;
+    int p, ty;
+
+    // Decode the 8x8 tile top to bottom
+    for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++) {
+
+        // Expand each bitplane byte into the 8 horizontal pixels
+        row_pixels = 0;
+        for (p=0; p < p_layout->BITPLANES; p++)
+            row_pixels |= romimg_bitplane_lut[ *(p_tile + p_layout->PLANE_OFFSET[p]
+                                                        + (ty * p_layout->PLANE_ROW_INCREMENT[p])) ] << p;
+
+        p_row = p_image_pixel + (ty * p_app_gfx->width * p_app_gfx->bytes_per_pixel);
+        romimg_set_decoded_row_and_advance(&p_row,
+                                           row_pixels,
+                                           0,
+                                           p_app_gfx);
+    }
+}
+
+
+
+unsigned int romimg_planar_encode_tile_scalar(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    uint64_t              row_pixels;
+    const unsigned char * p_row;
+    unsigned int          transparency_flag;
+    int p, ty, b;
+
+    transparency_flag = 0;
+
+    // Encode the 8x8 tile top to bottom
+    for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++) {
+
+        p_row = p_image_pixel + (ty * p_app_gfx->width * p_app_gfx->bytes_per_pixel);
+
+        // Collect the 8 horizontal pixels, leftmost pixel in the lowest byte
+        row_pixels = 0;
+        for (b=0; b < ROM_PLANAR_TILE_WIDTH; b++) {
+            row_pixels |= ((uint64_t) *p_row) << (b * 8);
+
+            // Log pixel transparency and advance to next pixel
+            romimg_log_transparent_pixel((unsigned char *)p_row, &transparency_flag, p_app_gfx);
+            p_row += p_app_gfx->bytes_per_pixel;
+        }
+
+        // Pull bit P of every pixel into one bitplane byte (leftmost pixel in the MS bit):
+        // the multiply moves the bit of pixel N to bit 63 - N, with no overlapping carries
+        for (p=0; p < p_layout->BITPLANES; p++)
+            *(p_tile + p_layout->PLANE_OFFSET[p] + (ty * p_layout->PLANE_ROW_INCREMENT[p]))
+                = (unsigned char)((((row_pixels >> p) & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56);
+    }
+
+    return transparency_flag;
+}
+
+
+
+// Portable 64 bit SWAR tile kernels (see rom_portable.h)
+void romimg_planar_decode_tile_swar(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    planar_swar_decode_tile(p_tile, p_layout, p_image_pixel, p_app_gfx);
+}
+
+
+unsigned int romimg_planar_encode_tile_swar(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    return planar_swar_encode_tile(p_image_pixel, p_layout, p_tile, p_app_gfx);
+}
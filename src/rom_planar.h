@@ -0,0 +1,98 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_PLANAR_FILE_HEADER
+#define ROM_PLANAR_FILE_HEADER
+
+#include <stdint.h>
+
+#include "lib_rom_bin.h"
+#include "rom_dispatch.h"
+
+#define ROM_PLANAR_TILE_WIDTH    8    // Planar tiles are always 8 pixels wide: one byte per bitplane row
+#define ROM_PLANAR_TILE_HEIGHT   8
+#define ROM_PLANAR_MAX_PLANES    8
+
+#define ROM_PLANAR_MAX_TILE_BYTES (ROM_PLANAR_TILE_HEIGHT * ROM_PLANAR_MAX_PLANES)
+
+    struct rom_planar_layout;
+
+    // Decodes one complete 8x8 tile into the image buffer, starting at the top-left pixel of the tile
+    typedef void (*romimg_planar_decode_tile_fn)(const unsigned char *, const struct rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+    // Encodes one complete 8x8 tile from the image buffer, starting at the top-left pixel of the tile
+    // Returns the number of transparent pixels found in the tile (see romimg_log_transparent_pixel)
+    typedef unsigned int (*romimg_planar_encode_tile_fn)(const unsigned char *, const struct rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+
+    // Describes where each bitplane of an 8x8 planar tile is stored
+    //
+    // Row N of bitplane P is at tile byte: PLANE_OFFSET[P] + (N * PLANE_ROW_INCREMENT[P])
+    //
+    // Only the first three fields are filled in by the format files, the rest
+    // are derived from them the first time a tile decoder / encoder is requested
+    typedef struct rom_planar_layout {
+        unsigned char BITPLANES;                                  // number of bitplanes (1-8)
+        unsigned char PLANE_OFFSET[ROM_PLANAR_MAX_PLANES];        // byte offset of the first row of each bitplane
+        unsigned char PLANE_ROW_INCREMENT[ROM_PLANAR_MAX_PLANES]; // byte increment to the next row of each bitplane
+
+        unsigned char PREPARED;
+        unsigned char TILE_BYTES;                                 // size of the tile in bytes
+        unsigned char ROW_MAJOR_INDEX[ROM_PLANAR_MAX_TILE_BYTES]; // tile byte of row N, bitplane 7-P is at [(N * 8) + P]
+        uint64_t      ROW_MAJOR_MASK;                             // set for each used entry of ROW_MAJOR_INDEX
+        unsigned char TILE_ORDER_INDEX[ROM_PLANAR_MAX_TILE_BYTES]; // entry [(N * 8) + P] (row N, bitplane P) stored at each tile byte
+        uint64_t      TILE_ORDER_MASK;                            // set for each tile byte which holds bitplane data
+
+        romimg_planar_decode_tile_fn DECODE_TILE;                 // selected once per process (see rom_dispatch.c)
+        romimg_planar_encode_tile_fn ENCODE_TILE;
+
+        romimg_planar_decode_tile_fn PORTABLE_DECODE_TILE;        // optional constant-layout SWAR kernels, used in place
+        romimg_planar_encode_tile_fn PORTABLE_ENCODE_TILE;        // of the generic ones (see rom_format.c)
+    } rom_planar_layout;
+
+
+    romimg_planar_decode_tile_fn romimg_planar_get_tile_decoder(rom_planar_layout *);
+    romimg_planar_encode_tile_fn romimg_planar_get_tile_encoder(rom_planar_layout *);
+
+    void romimg_planar_gather_tile(const unsigned char *, const rom_planar_layout *, unsigned char *);
+    void romimg_planar_scatter_tile(const unsigned char *, const rom_planar_layout *, unsigned char *);
+
+    void romimg_planar_decode_tile_scalar(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_planar_encode_tile_scalar(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+    void romimg_planar_decode_tile_swar(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_planar_encode_tile_swar(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+#ifdef ROM_DISPATCH_X86
+    uint64_t romimg_bmi2_strip_alpha(const uint64_t *, unsigned int *);
+
+    void romimg_planar_decode_tile_bmi2(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_planar_encode_tile_bmi2(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+    void romimg_planar_decode_tile_sse2(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+    void romimg_planar_decode_tile_avx2(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+    unsigned int romimg_planar_encode_tile_sse2(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_planar_encode_tile_avx2(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+
+    void romimg_planar_decode_tile_gfni(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+    unsigned int romimg_planar_encode_tile_gfni(const unsigned char *, const rom_planar_layout *, unsigned char *, app_gfx_data *);
+#endif
+
+#endif // ROM_PLANAR_FILE_HEADER
@@ -0,0 +1,478 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#include "rom_planar.h"
+
+#ifdef ROM_DISPATCH_X86
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "rom_simd_x86.h"
+
+
+// Planar -> indexed decode
+//
+// The tile is first gathered into plane-major order (8 bytes per bitplane,
+// one per row). Each bitplane row byte is then broadcast across the 8 pixel
+// lanes of its row, masked against the per-pixel bit (0x80 for the leftmost
+// pixel ... 0x01 for the rightmost) and compared, which turns every set bit
+// into 0xFF. That is ANDed down to the bitplane's bit and ORed into the pixels.
+//
+// Pixel lanes are finally stored to the image as-is (indexed) or interleaved
+// with an opaque alpha byte (indexed + alpha).
+
+
+__attribute__((target("sse2")))
+static __m128i sse2_expand_bitplane(__m128i row_bytes, __m128i bit_mask, __m128i plane_bit)
+{
+    return _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(row_bytes, bit_mask), bit_mask),
+                         plane_bit);
+}
+
+
+// Two tile rows per register: rows[0] = rows 0 & 1, ... rows[3] = rows 6 & 7
+__attribute__((target("sse2")))
+void romimg_planar_decode_tile_sse2(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    unsigned char planes[ROM_PLANAR_MAX_PLANES * ROM_PLANAR_TILE_HEIGHT];
+    __m128i rows[4];
+    __m128i bit_mask, plane_bit;
+    __m128i row_bytes, rows_lo, rows_hi;
+    long int image_stride;
+    int p, r;
+
+    romimg_planar_gather_tile(p_tile, p_layout, planes);
+
+    bit_mask = _mm_set1_epi64x(0x0102040810204080LL);
+
+    for (r=0; r < 4; r++)
+        rows[r] = _mm_setzero_si128();
+
+    for (p=0; p < p_layout->BITPLANES; p++) {
+
+        plane_bit = _mm_set1_epi8((char)(1 << p));
+
+        // Broadcast each row byte: r0 x8 r1 x8 | r2 x8 r3 x8 | ...
+        row_bytes = _mm_loadl_epi64((const __m128i *)(planes + (p * ROM_PLANAR_TILE_HEIGHT)));
+        row_bytes = _mm_unpacklo_epi8(row_bytes, row_bytes);
+        rows_lo   = _mm_unpacklo_epi16(row_bytes, row_bytes);
+        rows_hi   = _mm_unpackhi_epi16(row_bytes, row_bytes);
+
+        rows[0] = _mm_or_si128(rows[0], sse2_expand_bitplane(_mm_unpacklo_epi32(rows_lo, rows_lo), bit_mask, plane_bit));
+        rows[1] = _mm_or_si128(rows[1], sse2_expand_bitplane(_mm_unpackhi_epi32(rows_lo, rows_lo), bit_mask, plane_bit));
+        rows[2] = _mm_or_si128(rows[2], sse2_expand_bitplane(_mm_unpacklo_epi32(rows_hi, rows_hi), bit_mask, plane_bit));
+        rows[3] = _mm_or_si128(rows[3], sse2_expand_bitplane(_mm_unpackhi_epi32(rows_hi, rows_hi), bit_mask, plane_bit));
+    }
+
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    for (r=0; r < 4; r++)
+        sse2_store_rows(p_image_pixel + (r * 2 * image_stride), image_stride, rows[r], p_app_gfx);
+}
+
+
+
+__attribute__((target("avx2")))
+static __m256i avx2_expand_bitplane(__m256i row_bytes, __m256i bit_mask, __m256i plane_bit)
+{
+    return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(row_bytes, bit_mask), bit_mask),
+                            plane_bit);
+}
+
+
+// Four tile rows per register: rows 0-3 and rows 4-7
+__attribute__((target("avx2")))
+void romimg_planar_decode_tile_avx2(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    unsigned char planes[ROM_PLANAR_MAX_PLANES * ROM_PLANAR_TILE_HEIGHT];
+    __m256i rows_0_3, rows_4_7;
+    __m256i bit_mask, plane_bit, plane_rows;
+    __m256i broadcast_0_3, broadcast_4_7;
+    long int image_stride;
+    int64_t  plane_bytes;
+    int p;
+
+    romimg_planar_gather_tile(p_tile, p_layout, planes);
+
+    bit_mask = _mm256_set1_epi64x(0x0102040810204080LL);
+
+    // Shuffle indexes which broadcast a row byte across 8 lanes (per 128 bit lane)
+    broadcast_0_3 = _mm256_setr_epi8(0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1,
+                                     2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3);
+    broadcast_4_7 = _mm256_setr_epi8(4,4,4,4,4,4,4,4, 5,5,5,5,5,5,5,5,
+                                     6,6,6,6,6,6,6,6, 7,7,7,7,7,7,7,7);
+
+    rows_0_3 = _mm256_setzero_si256();
+    rows_4_7 = _mm256_setzero_si256();
+
+    for (p=0; p < p_layout->BITPLANES; p++) {
+
+        plane_bit = _mm256_set1_epi8((char)(1 << p));
+
+        memcpy(&plane_bytes, planes + (p * ROM_PLANAR_TILE_HEIGHT), sizeof(plane_bytes));
+        plane_rows = _mm256_set1_epi64x(plane_bytes);
+
+        rows_0_3 = _mm256_or_si256(rows_0_3, avx2_expand_bitplane(_mm256_shuffle_epi8(plane_rows, broadcast_0_3), bit_mask, plane_bit));
+        rows_4_7 = _mm256_or_si256(rows_4_7, avx2_expand_bitplane(_mm256_shuffle_epi8(plane_rows, broadcast_4_7), bit_mask, plane_bit));
+    }
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    avx2_store_rows(p_image_pixel,                    image_stride, rows_0_3, p_app_gfx);
+    avx2_store_rows(p_image_pixel + image_stride * 4, image_stride, rows_4_7, p_app_gfx);
+
+    // Avoid AVX <-> SSE transition stalls in the (non-VEX) calling code
+    _mm256_zeroupper();
+}
+
+
+
+
+// Indexed -> planar encode
+//
+// The pixel order inside each tile row is reversed first so that the leftmost
+// pixel ends up in the MS bit. For each bitplane the pixels are then shifted so
+// that bitplane's bit lands in bit 7 of every byte, and movemask collects one
+// bit per pixel: one bitplane byte per tile row in a single instruction.
+//
+// In indexed + alpha mode the alpha bytes are split off at the same time and
+// compared against zero to count the transparent pixels in the tile.
+
+
+__attribute__((target("sse2")))
+unsigned int romimg_planar_encode_tile_sse2(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    unsigned char planes[ROM_PLANAR_MAX_PLANES * ROM_PLANAR_TILE_HEIGHT];
+    unsigned int  transparency_flag;
+    __m128i       rows;
+    long int      image_stride;
+    int           p, r, plane_bits;
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    for (r=0; r < ROM_PLANAR_TILE_HEIGHT; r += 2) {
+
+        rows = sse2_load_rows(p_image_pixel + (r * image_stride), image_stride, &transparency_flag, p_app_gfx);
+
+        // Reverse the byte order of each row: reverse the 16 bit words, then swap the bytes in each
+        rows = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rows, 0x1B), 0x1B);
+        rows = _mm_or_si128(_mm_slli_epi16(rows, 8), _mm_srli_epi16(rows, 8));
+
+        for (p=0; p < p_layout->BITPLANES; p++) {
+            plane_bits = _mm_movemask_epi8(_mm_slli_epi16(rows, 7 - p));
+
+            planes[(p * ROM_PLANAR_TILE_HEIGHT) + r]     = (unsigned char)(plane_bits);
+            planes[(p * ROM_PLANAR_TILE_HEIGHT) + r + 1] = (unsigned char)(plane_bits >> 8);
+        }
+    }
+
+    romimg_planar_scatter_tile(planes, p_layout, p_tile);
+
+    return transparency_flag;
+}
+
+
+
+__attribute__((target("avx2")))
+unsigned int romimg_planar_encode_tile_avx2(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    unsigned char planes[ROM_PLANAR_MAX_PLANES * ROM_PLANAR_TILE_HEIGHT];
+    unsigned int  transparency_flag;
+    unsigned int  plane_bits;
+    __m256i       rows, reverse_rows;
+    long int      image_stride;
+    int           p, r;
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    reverse_rows = _mm256_setr_epi8(7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8,
+                                    7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8);
+
+    for (r=0; r < ROM_PLANAR_TILE_HEIGHT; r += 4) {
+
+        rows = avx2_load_rows(p_image_pixel + (r * image_stride), image_stride, &transparency_flag, p_app_gfx);
+        rows = _mm256_shuffle_epi8(rows, reverse_rows);
+
+        for (p=0; p < p_layout->BITPLANES; p++) {
+            plane_bits = (unsigned int)_mm256_movemask_epi8(_mm256_slli_epi16(rows, 7 - p));
+
+            planes[(p * ROM_PLANAR_TILE_HEIGHT) + r]     = (unsigned char)(plane_bits);
+            planes[(p * ROM_PLANAR_TILE_HEIGHT) + r + 1] = (unsigned char)(plane_bits >> 8);
+            planes[(p * ROM_PLANAR_TILE_HEIGHT) + r + 2] = (unsigned char)(plane_bits >> 16);
+            planes[(p * ROM_PLANAR_TILE_HEIGHT) + r + 3] = (unsigned char)(plane_bits >> 24);
+        }
+    }
+
+    // Avoid AVX <-> SSE transition stalls in the (non-VEX) calling code
+    _mm256_zeroupper();
+
+    romimg_planar_scatter_tile(planes, p_layout, p_tile);
+
+    return transparency_flag;
+}
+
+
+
+
+// GFNI + AVX-512 tile decode / encode
+//
+// Converting between bitplanes and pixel indexes is an 8x8 bit matrix
+// transpose per tile row, which GF2P8AFFINEQB does for 8 rows (a whole
+// tile) in one instruction: with the 8 bitplane bytes of a row as the matrix
+// and a byte selecting each pixel's bit as the vector, every result byte is
+// one pixel. Swapping the roles (pixels as the matrix, a byte selecting each
+// bitplane as the vector) transposes back.
+//
+// The bytes of a tile are moved between rom order and row-major order with
+// a single byte permute using the tables from romimg_planar_prepare_layout(),
+// and loaded / stored with byte masks so nothing past the tile is touched.
+
+#define GFNI_TARGET "gfni,avx512f,avx512bw,avx512vbmi"
+
+// Byte N of each 64 bit lane selects bit 7-N: pixel N (leftmost pixel = MS bit)
+#define GFNI_SELECT_PIXEL_BITS  0x0102040810204080LL
+// Byte P of each 64 bit lane selects bit P: bitplane P
+#define GFNI_SELECT_PLANE_BITS  0x8040201008040201LL
+
+
+// Combine four 16 byte values into one register, first value lowest
+__attribute__((target(GFNI_TARGET)))
+static __m512i gfni_combine_4x128(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    __m512i v;
+
+    v = _mm512_castsi128_si512(a);
+    v = _mm512_inserti32x4(v, b, 1);
+    v = _mm512_inserti32x4(v, c, 2);
+    return _mm512_inserti32x4(v, d, 3);
+}
+
+
+// Byte offsets of the 8 tile rows in the image, one per 64 bit lane
+__attribute__((target(GFNI_TARGET)))
+static __m512i gfni_row_offsets(long int image_stride)
+{
+    return _mm512_setr_epi64(0,                image_stride,     image_stride * 2, image_stride * 3,
+                             image_stride * 4, image_stride * 5, image_stride * 6, image_stride * 7);
+}
+
+
+__attribute__((target(GFNI_TARGET)))
+void romimg_planar_decode_tile_gfni(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    __m512i  tile, rows, rows_even, rows_odd, alpha;
+    long int image_stride;
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    // Load the tile and arrange it as 8 rows of 8 bitplane bytes, then transpose each row into 8 pixels
+    tile = _mm512_maskz_loadu_epi8(p_layout->TILE_ORDER_MASK, p_tile);
+    rows = _mm512_maskz_permutexvar_epi8(p_layout->ROW_MAJOR_MASK,
+                                         _mm512_loadu_si512(p_layout->ROW_MAJOR_INDEX),
+                                         tile);
+    rows = _mm512_gf2p8affine_epi64_epi8(_mm512_set1_epi64(GFNI_SELECT_PIXEL_BITS), rows, 0);
+
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+
+        // Interleave with opaque alpha, each 128 bit lane holds two tile rows
+        alpha     = _mm512_set1_epi8((char)0xFF);
+        rows_even = _mm512_unpacklo_epi8(rows, alpha); // rows 0, 2, 4, 6
+        rows_odd  = _mm512_unpackhi_epi8(rows, alpha); // rows 1, 3, 5, 7
+
+        _mm_storeu_si128((__m128i *)(p_image_pixel),                    _mm512_castsi512_si128(rows_even));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride),     _mm512_castsi512_si128(rows_odd));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 2), _mm512_extracti32x4_epi32(rows_even, 1));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 3), _mm512_extracti32x4_epi32(rows_odd, 1));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 4), _mm512_extracti32x4_epi32(rows_even, 2));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 5), _mm512_extracti32x4_epi32(rows_odd, 2));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 6), _mm512_extracti32x4_epi32(rows_even, 3));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 7), _mm512_extracti32x4_epi32(rows_odd, 3));
+    }
+    else {
+        // One tile row per 64 bit lane
+        _mm512_mask_i64scatter_epi64(p_image_pixel, 0xFF,
+                                     gfni_row_offsets(image_stride),
+                                     rows, 1);
+    }
+
+    // Avoid AVX <-> SSE transition stalls in the (non-VEX) calling code
+    _mm256_zeroupper();
+}
+
+
+__attribute__((target(GFNI_TARGET)))
+unsigned int romimg_planar_encode_tile_gfni(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    const unsigned char * p_row;
+    unsigned int transparency_flag;
+    __m512i      rows_0_3, rows_4_7, rows, even_bytes, alpha_mask, tile;
+    long int     image_stride;
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+
+        p_row = p_image_pixel;
+        rows_0_3 = gfni_combine_4x128(_mm_loadu_si128((const __m128i *)(p_row)),
+                                      _mm_loadu_si128((const __m128i *)(p_row + image_stride)),
+                                      _mm_loadu_si128((const __m128i *)(p_row + image_stride * 2)),
+                                      _mm_loadu_si128((const __m128i *)(p_row + image_stride * 3)));
+        p_row += image_stride * 4;
+        rows_4_7 = gfni_combine_4x128(_mm_loadu_si128((const __m128i *)(p_row)),
+                                      _mm_loadu_si128((const __m128i *)(p_row + image_stride)),
+                                      _mm_loadu_si128((const __m128i *)(p_row + image_stride * 2)),
+                                      _mm_loadu_si128((const __m128i *)(p_row + image_stride * 3)));
+
+        // Count pixels with a fully transparent alpha mask byte
+        alpha_mask = _mm512_set1_epi16((short)0xFF00);
+        transparency_flag = __builtin_popcount(_mm512_testn_epi16_mask(rows_0_3, alpha_mask))
+                          + __builtin_popcount(_mm512_testn_epi16_mask(rows_4_7, alpha_mask));
+
+        // Keep the index bytes (even bytes) of both halves
+        even_bytes = _mm512_setr_epi64(0x0E0C0A0806040200LL, 0x1E1C1A1816141210LL,
+                                       0x2E2C2A2826242220LL, 0x3E3C3A3836343230LL,
+                                       0x4E4C4A4846444240LL, 0x5E5C5A5856545250LL,
+                                       0x6E6C6A6866646260LL, 0x7E7C7A7876747270LL);
+        rows = _mm512_permutex2var_epi8(rows_0_3, even_bytes, rows_4_7);
+    }
+    else {
+        // One tile row per 64 bit lane
+        rows = _mm512_i64gather_epi64(gfni_row_offsets(image_stride),
+                                      p_image_pixel, 1);
+    }
+
+    // Transpose each row into its 8 bitplane bytes, then put them in rom order
+    rows = _mm512_gf2p8affine_epi64_epi8(_mm512_set1_epi64(GFNI_SELECT_PLANE_BITS), rows, 0);
+    tile = _mm512_permutexvar_epi8(_mm512_loadu_si512(p_layout->TILE_ORDER_INDEX), rows);
+    _mm512_mask_storeu_epi8(p_tile, p_layout->TILE_ORDER_MASK, tile);
+
+    // Avoid AVX <-> SSE transition stalls in the (non-VEX) calling code
+    _mm256_zeroupper();
+
+    return transparency_flag;
+}
+
+
+
+
+// BMI2 tile decode / encode
+//
+// PDEP scatters the 8 bits of a bitplane byte to the same bit of the 8 pixel
+// bytes of a row, PEXT gathers them back. Pixel order is reversed with a byte
+// swap, as the leftmost pixel is the MS bit of a bitplane byte.
+//
+// No vector registers are used, so there is no setup cost: this is mainly
+// useful on CPUs with BMI2 but without (fast) AVX2.
+
+#define BMI2_TARGET "bmi2,popcnt"
+
+
+// Split 8 indexed + alpha pixels into their 8 index bytes (returned) and
+// count the pixels with a fully transparent (zero) alpha byte
+// (shared with the packed format kernels)
+__attribute__((target(BMI2_TARGET)))
+uint64_t romimg_bmi2_strip_alpha(const uint64_t * p_row_alpha, unsigned int * p_transparency_flag)
+{
+    uint64_t alpha;
+
+    alpha = _pext_u64(p_row_alpha[0], 0xFF00FF00FF00FF00ULL)
+          | (_pext_u64(p_row_alpha[1], 0xFF00FF00FF00FF00ULL) << 32);
+
+    // The top bit of each byte ends up set when the alpha byte is non-zero
+    alpha = ((alpha & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | alpha;
+    *p_transparency_flag += 8 - __builtin_popcountll(alpha & 0x8080808080808080ULL);
+
+    return _pext_u64(p_row_alpha[0], 0x00FF00FF00FF00FFULL)
+         | (_pext_u64(p_row_alpha[1], 0x00FF00FF00FF00FFULL) << 32);
+}
+
+
+__attribute__((target(BMI2_TARGET)))
+void romimg_planar_decode_tile_bmi2(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    uint64_t        row_pixels, row_alpha[2];
+    unsigned char * p_row;
+    long int        image_stride;
+    int p, ty;
+
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++) {
+
+        // Deposit bitplane P into bit P of every pixel, pixel 7 first
+        row_pixels = 0;
+        for (p=0; p < p_layout->BITPLANES; p++)
+            row_pixels |= _pdep_u64(*(p_tile + p_layout->PLANE_OFFSET[p] + (ty * p_layout->PLANE_ROW_INCREMENT[p])),
+                                    0x0101010101010101ULL << p);
+
+        row_pixels = __builtin_bswap64(row_pixels);
+        p_row = p_image_pixel + (ty * image_stride);
+
+        if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+            // Interleave with opaque alpha
+            row_alpha[0] = _pdep_u64(row_pixels,       0x00FF00FF00FF00FFULL) | 0xFF00FF00FF00FF00ULL;
+            row_alpha[1] = _pdep_u64(row_pixels >> 32, 0x00FF00FF00FF00FFULL) | 0xFF00FF00FF00FF00ULL;
+            memcpy(p_row, row_alpha, sizeof(row_alpha));
+        }
+        else
+            memcpy(p_row, &row_pixels, sizeof(row_pixels));
+    }
+}
+
+
+__attribute__((target(BMI2_TARGET)))
+unsigned int romimg_planar_encode_tile_bmi2(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    uint64_t              row_pixels, row_alpha[2];
+    const unsigned char * p_row;
+    unsigned int          transparency_flag;
+    long int              image_stride;
+    int p, ty;
+
+    transparency_flag = 0;
+    image_stride = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty++) {
+
+        p_row = p_image_pixel + (ty * image_stride);
+
+        if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+            memcpy(row_alpha, p_row, sizeof(row_alpha));
+            row_pixels = romimg_bmi2_strip_alpha(row_alpha, &transparency_flag);
+        }
+        else
+            memcpy(&row_pixels, p_row, sizeof(row_pixels));
+
+        // Extract bit P of every pixel into bitplane P, leftmost pixel in the MS bit
+        row_pixels = __builtin_bswap64(row_pixels);
+        for (p=0; p < p_layout->BITPLANES; p++)
+            *(p_tile + p_layout->PLANE_OFFSET[p] + (ty * p_layout->PLANE_ROW_INCREMENT[p]))
+                = (unsigned char)_pext_u64(row_pixels, 0x0101010101010101ULL << p);
+    }
+
+    return transparency_flag;
+}
+
+#endif // ROM_DISPATCH_X86
@@ -0,0 +1,298 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_PORTABLE_FILE_HEADER
+#define ROM_PORTABLE_FILE_HEADER
+
+// Portable tile kernel bodies
+//
+// These are inlined into the generic kernels (rom_planar.c / rom_packed.c),
+// which take the layout at run time, and into the constant-layout kernels of
+// the built-in formats (rom_format.c), where the compiler can fold the
+// bitplane offsets / pixel positions into the code.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lib_rom_bin.h"
+#include "rom_utils.h"
+#include "rom_planar.h"
+#include "rom_packed.h"
+
+
+
+// Portable 64 bit SWAR ("SIMD within a register") tile decode / encode
+//
+// Up to 8 bitplane bytes are packed into one 64 bit word, byte J holding
+// (row, bitplane) number J, which makes it an 8x8 bit matrix. Transposing
+// that matrix turns it into one byte per pixel (pixel 7 in the lowest byte)
+// with bit J of every pixel coming from (row, bitplane) J. Byte swapping
+// puts the leftmost pixel in the lowest byte, after which each row is just a
+// shift and a mask. Encoding runs the same steps backwards.
+//
+// With fewer than 8 bitplanes several rows share one word (4 rows for 2bpp),
+// so a 2bpp tile takes 2 transposes and an 8bpp tile takes 8.
+
+// Transpose an 8x8 bit matrix: bit (8 * R) + C <-> bit (8 * C) + R
+// (Hacker's Delight, transpose8)
+static inline uint64_t planar_swar_transpose8x8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7))  & 0x00AA00AA00AA00AAULL;  x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;  x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;  x = x ^ t ^ (t << 28);
+
+    return x;
+}
+
+
+static inline uint64_t planar_swar_bswap64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap64(x);
+#else
+    x = ((x & 0x00FF00FF00FF00FFULL) << 8)  | ((x >> 8)  & 0x00FF00FF00FF00FFULL);
+    x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+    return (x << 32) | (x >> 32);
+#endif
+}
+
+
+// Little-endian 64 bit load / store, independent of the host byte order
+// (compilers turn these into a single move on little-endian hosts)
+static inline uint64_t planar_swar_load_le64(const unsigned char * p_src)
+{
+    return  ((uint64_t)p_src[0])        | ((uint64_t)p_src[1] << 8)  |
+            ((uint64_t)p_src[2] << 16)  | ((uint64_t)p_src[3] << 24) |
+            ((uint64_t)p_src[4] << 32)  | ((uint64_t)p_src[5] << 40) |
+            ((uint64_t)p_src[6] << 48)  | ((uint64_t)p_src[7] << 56);
+}
+
+
+static inline void planar_swar_store_le64(unsigned char * p_dest, uint64_t x)
+{
+    p_dest[0] = (unsigned char)(x);        p_dest[1] = (unsigned char)(x >> 8);
+    p_dest[2] = (unsigned char)(x >> 16);  p_dest[3] = (unsigned char)(x >> 24);
+    p_dest[4] = (unsigned char)(x >> 32);  p_dest[5] = (unsigned char)(x >> 40);
+    p_dest[6] = (unsigned char)(x >> 48);  p_dest[7] = (unsigned char)(x >> 56);
+}
+
+
+// Spread 4 pixels (bytes 0-3) to 16 bit lanes with an opaque alpha byte in the high half
+static inline uint64_t planar_swar_add_alpha(uint64_t x)
+{
+    x &= 0x00000000FFFFFFFFULL;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+    return x | 0xFF00FF00FF00FF00ULL;
+}
+
+
+// Pack the index bytes of 4 indexed + alpha pixels into bytes 0-3,
+// and count the pixels with a fully transparent (zero) alpha byte
+static inline uint64_t planar_swar_strip_alpha(uint64_t x, unsigned int * p_transparency_flag)
+{
+    uint64_t alpha;
+
+    // Bit 8 of each 16 bit lane ends up set when its alpha byte is non-zero,
+    // the multiply then sums those 4 bits into the top lane
+    alpha = ((((x >> 8) & 0x00FF00FF00FF00FFULL) + 0x00FF00FF00FF00FFULL) >> 8) & 0x0001000100010001ULL;
+    *p_transparency_flag += 4 - (unsigned int)((alpha * 0x0001000100010001ULL) >> 48);
+
+    x &= 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8))  & 0x0000FFFF0000FFFFULL;
+    return (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+}
+
+
+
+static inline void planar_swar_decode_tile(const unsigned char * p_tile, const rom_planar_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    uint64_t        packed, row_pixels, pixel_mask;
+    unsigned char * p_row;
+    long int        image_stride;
+    int rows_per_word, p, ty, r, plane_byte;
+
+    image_stride  = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+    rows_per_word = ROM_PLANAR_MAX_PLANES / p_layout->BITPLANES;
+    pixel_mask    = 0x0101010101010101ULL * ((1U << p_layout->BITPLANES) - 1);
+
+    for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty += rows_per_word) {
+
+        // Pack the bitplane bytes of the next rows, rows and bitplanes in ascending order
+        packed = 0;
+        plane_byte = 0;
+        for (r=ty; (r < ty + rows_per_word) && (r < ROM_PLANAR_TILE_HEIGHT); r++) {
+            for (p=0; p < p_layout->BITPLANES; p++)
+                packed |= ((uint64_t) *(p_tile + p_layout->PLANE_OFFSET[p]
+                                               + (r * p_layout->PLANE_ROW_INCREMENT[p]))) << (8 * plane_byte++);
+        }
+
+        packed = planar_swar_bswap64(planar_swar_transpose8x8(packed));
+
+        // Each row now sits in its own group of bits of every pixel byte
+        for (r=ty; (r < ty + rows_per_word) && (r < ROM_PLANAR_TILE_HEIGHT); r++) {
+
+            row_pixels = (packed >> ((r - ty) * p_layout->BITPLANES)) & pixel_mask;
+            p_row = p_image_pixel + (r * image_stride);
+
+            if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+                planar_swar_store_le64(p_row,     planar_swar_add_alpha(row_pixels));
+                planar_swar_store_le64(p_row + 8, planar_swar_add_alpha(row_pixels >> 32));
+            }
+            else
+                planar_swar_store_le64(p_row, row_pixels);
+        }
+    }
+}
+
+
+
+static inline unsigned int planar_swar_encode_tile(const unsigned char * p_image_pixel, const rom_planar_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    uint64_t              packed, row_pixels, pixel_mask;
+    const unsigned char * p_row;
+    unsigned int          transparency_flag;
+    long int              image_stride;
+    int rows_per_word, p, ty, r, plane_byte;
+
+    transparency_flag = 0;
+    image_stride  = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+    rows_per_word = ROM_PLANAR_MAX_PLANES / p_layout->BITPLANES;
+    pixel_mask    = 0x0101010101010101ULL * ((1U << p_layout->BITPLANES) - 1);
+
+    for (ty=0; ty < ROM_PLANAR_TILE_HEIGHT; ty += rows_per_word) {
+
+        // Combine the next rows into one word, each row in its own group of bits of every pixel byte
+        packed = 0;
+        for (r=ty; (r < ty + rows_per_word) && (r < ROM_PLANAR_TILE_HEIGHT); r++) {
+
+            p_row = p_image_pixel + (r * image_stride);
+
+            if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel)
+                row_pixels = planar_swar_strip_alpha(planar_swar_load_le64(p_row), &transparency_flag)
+                           | (planar_swar_strip_alpha(planar_swar_load_le64(p_row + 8), &transparency_flag) << 32);
+            else
+                row_pixels = planar_swar_load_le64(p_row);
+
+            packed |= (row_pixels & pixel_mask) << ((r - ty) * p_layout->BITPLANES);
+        }
+
+        packed = planar_swar_transpose8x8(planar_swar_bswap64(packed));
+
+        // Byte J of the result is now (row, bitplane) number J, leftmost pixel in the MS bit
+        plane_byte = 0;
+        for (r=ty; (r < ty + rows_per_word) && (r < ROM_PLANAR_TILE_HEIGHT); r++) {
+            for (p=0; p < p_layout->BITPLANES; p++)
+                *(p_tile + p_layout->PLANE_OFFSET[p] + (r * p_layout->PLANE_ROW_INCREMENT[p]))
+                    = (unsigned char)(packed >> (8 * plane_byte++));
+        }
+    }
+
+    return transparency_flag;
+}
+
+
+
+// Returns the bit shift of pixel N (0-7) of a tile row within its byte,
+// and sets *p_byte to the byte of the row which holds it
+static inline int packed_pixel_position(const rom_packed_layout * p_layout, int n, int * p_byte)
+{
+    int pixels_per_byte, pixel_in_byte;
+
+    pixels_per_byte = 8 / p_layout->BITS_PER_PIXEL;
+    pixel_in_byte   = n % pixels_per_byte;
+
+    *p_byte = n / pixels_per_byte;
+    if (p_layout->BYTES_REVERSED)
+        *p_byte = p_layout->BITS_PER_PIXEL - 1 - *p_byte;
+
+    if (p_layout->MS_PIXEL_FIRST)
+        pixel_in_byte = pixels_per_byte - 1 - pixel_in_byte;
+
+    return pixel_in_byte * p_layout->BITS_PER_PIXEL;
+}
+
+
+
+static inline void packed_scalar_decode_tile(const unsigned char * p_tile, const rom_packed_layout * p_layout, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx)
+{
+    uint64_t        row_pixels;
+    unsigned char * p_row;
+    unsigned char   pixel_mask;
+    int ty, b, shift, row_byte;
+
+    pixel_mask = (unsigned char)((1U << p_layout->BITS_PER_PIXEL) - 1);
+
+    // Decode the 8x8 tile top to bottom
+    for (ty=0; ty < ROM_PACKED_TILE_HEIGHT; ty++) {
+
+        // Unpack the 8 horizontal pixels of the row
+        row_pixels = 0;
+        for (b=0; b < ROM_PACKED_TILE_WIDTH; b++) {
+            shift = packed_pixel_position(p_layout, b, &row_byte);
+            row_pixels |= ((uint64_t)((p_tile[row_byte] >> shift) & pixel_mask)) << (b * 8);
+        }
+
+        p_row = p_image_pixel + (ty * p_app_gfx->width * p_app_gfx->bytes_per_pixel);
+        romimg_set_decoded_row_and_advance(&p_row,
+                                           row_pixels,
+                                           0,
+                                           p_app_gfx);
+
+        p_tile += p_layout->BITS_PER_PIXEL;
+    }
+}
+
+
+
+static inline unsigned int packed_scalar_encode_tile(const unsigned char * p_image_pixel, const rom_packed_layout * p_layout, unsigned char * p_tile, app_gfx_data * p_app_gfx)
+{
+    const unsigned char * p_row;
+    unsigned int          transparency_flag;
+    unsigned char         pixel_mask;
+    int ty, b, shift, row_byte;
+
+    transparency_flag = 0;
+    pixel_mask = (unsigned char)((1U << p_layout->BITS_PER_PIXEL) - 1);
+
+    // Encode the 8x8 tile top to bottom
+    for (ty=0; ty < ROM_PACKED_TILE_HEIGHT; ty++) {
+
+        p_row = p_image_pixel + (ty * p_app_gfx->width * p_app_gfx->bytes_per_pixel);
+        memset(p_tile, 0, p_layout->BITS_PER_PIXEL);
+
+        // Pack the 8 horizontal pixels of the row
+        for (b=0; b < ROM_PACKED_TILE_WIDTH; b++) {
+            shift = packed_pixel_position(p_layout, b, &row_byte);
+            p_tile[row_byte] |= (unsigned char)((*p_row & pixel_mask) << shift);
+
+            // Log pixel transparency and advance to next pixel
+            romimg_log_transparent_pixel((unsigned char *)p_row, &transparency_flag, p_app_gfx);
+            p_row += p_app_gfx->bytes_per_pixel;
+        }
+
+        p_tile += p_layout->BITS_PER_PIXEL;
+    }
+
+    return transparency_flag;
+}
+
+#endif // ROM_PORTABLE_FILE_HEADER
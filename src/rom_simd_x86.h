@@ -0,0 +1,147 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_SIMD_X86_FILE_HEADER
+#define ROM_SIMD_X86_FILE_HEADER
+
+// Load / store helpers shared by the SSE2 and AVX2 tile kernels
+//
+// Only include this from x86 kernel files (ROM_DISPATCH_X86), after <immintrin.h>.
+// The helpers are inlined into each kernel, so they take on its target flags.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lib_rom_bin.h"
+
+
+
+// Load two tile rows of pixel indexes into one register (row 0 low, row 1 high)
+// In indexed + alpha mode the transparent pixels are counted into *p_transparency_flag
+__attribute__((target("sse2")))
+static inline __m128i sse2_load_rows(const unsigned char * p_image_pixel, long int image_stride, unsigned int * p_transparency_flag, app_gfx_data * p_app_gfx)
+{
+    __m128i row_a, row_b, index_mask, alpha;
+
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+
+        row_a = _mm_loadu_si128((const __m128i *)(p_image_pixel));
+        row_b = _mm_loadu_si128((const __m128i *)(p_image_pixel + image_stride));
+
+        // Count pixels with a fully transparent alpha mask byte
+        alpha = _mm_packus_epi16(_mm_srli_epi16(row_a, 8), _mm_srli_epi16(row_b, 8));
+        *p_transparency_flag += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, _mm_setzero_si128())));
+
+        index_mask = _mm_set1_epi16(0x00FF);
+        return _mm_packus_epi16(_mm_and_si128(row_a, index_mask), _mm_and_si128(row_b, index_mask));
+    }
+    else {
+        row_a = _mm_loadl_epi64((const __m128i *)(p_image_pixel));
+        row_b = _mm_loadl_epi64((const __m128i *)(p_image_pixel + image_stride));
+
+        return _mm_unpacklo_epi64(row_a, row_b);
+    }
+}
+
+
+// Store two tile rows of pixel indexes (row 0 low, row 1 high) to the image,
+// with opaque alpha in indexed + alpha mode
+__attribute__((target("sse2")))
+static inline void sse2_store_rows(unsigned char * p_image_pixel, long int image_stride, __m128i rows, app_gfx_data * p_app_gfx)
+{
+    __m128i alpha;
+
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+
+        alpha = _mm_set1_epi8((char)0xFF);
+
+        _mm_storeu_si128((__m128i *)(p_image_pixel), _mm_unpacklo_epi8(rows, alpha));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride), _mm_unpackhi_epi8(rows, alpha));
+    }
+    else {
+        _mm_storel_epi64((__m128i *)(p_image_pixel), rows);
+        _mm_storel_epi64((__m128i *)(p_image_pixel + image_stride), _mm_unpackhi_epi64(rows, rows));
+    }
+}
+
+
+
+// Load four tile rows of pixel indexes into one register (rows 0, 1 | rows 2, 3)
+// In indexed + alpha mode the transparent pixels are counted into *p_transparency_flag
+__attribute__((target("avx2")))
+static inline __m256i avx2_load_rows(const unsigned char * p_image_pixel, long int image_stride, unsigned int * p_transparency_flag, app_gfx_data * p_app_gfx)
+{
+    __m256i rows_a, rows_b, index_mask, alpha;
+    int64_t row[4];
+    int r;
+
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+
+        // rows_a = row 0 | row 2, rows_b = row 1 | row 3
+        rows_a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p_image_pixel))),
+                                         _mm_loadu_si128((const __m128i *)(p_image_pixel + image_stride * 2)), 1);
+        rows_b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p_image_pixel + image_stride))),
+                                         _mm_loadu_si128((const __m128i *)(p_image_pixel + image_stride * 3)), 1);
+
+        // Count pixels with a fully transparent alpha mask byte
+        alpha = _mm256_packus_epi16(_mm256_srli_epi16(rows_a, 8), _mm256_srli_epi16(rows_b, 8));
+        *p_transparency_flag += __builtin_popcount((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(alpha, _mm256_setzero_si256())));
+
+        index_mask = _mm256_set1_epi16(0x00FF);
+        return _mm256_packus_epi16(_mm256_and_si256(rows_a, index_mask), _mm256_and_si256(rows_b, index_mask));
+    }
+    else {
+        for (r=0; r < 4; r++)
+            memcpy(&row[r], p_image_pixel + (r * image_stride), sizeof(row[r]));
+
+        return _mm256_setr_epi64x(row[0], row[1], row[2], row[3]);
+    }
+}
+
+
+// Store four tile rows of pixel indexes (rows 0, 1 | rows 2, 3) to the image,
+// with opaque alpha in indexed + alpha mode
+__attribute__((target("avx2")))
+static inline void avx2_store_rows(unsigned char * p_image_pixel, long int image_stride, __m256i rows, app_gfx_data * p_app_gfx)
+{
+    __m256i lo, hi;
+
+    // rows = row 0, row 1 | row 2, row 3
+    if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
+
+        lo = _mm256_unpacklo_epi8(rows, _mm256_set1_epi8((char)0xFF)); // row 0 | row 2
+        hi = _mm256_unpackhi_epi8(rows, _mm256_set1_epi8((char)0xFF)); // row 1 | row 3
+
+        _mm_storeu_si128((__m128i *)(p_image_pixel),                    _mm256_castsi256_si128(lo));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride),     _mm256_castsi256_si128(hi));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 2), _mm256_extracti128_si256(lo, 1));
+        _mm_storeu_si128((__m128i *)(p_image_pixel + image_stride * 3), _mm256_extracti128_si256(hi, 1));
+    }
+    else {
+        lo = rows;
+        hi = _mm256_unpackhi_epi64(rows, rows);
+
+        _mm_storel_epi64((__m128i *)(p_image_pixel),                    _mm256_castsi256_si128(lo));
+        _mm_storel_epi64((__m128i *)(p_image_pixel + image_stride),     _mm256_castsi256_si128(hi));
+        _mm_storel_epi64((__m128i *)(p_image_pixel + image_stride * 2), _mm256_extracti128_si256(lo, 1));
+        _mm_storel_epi64((__m128i *)(p_image_pixel + image_stride * 3), _mm256_extracti128_si256(hi, 1));
+    }
+}
+
+#endif // ROM_SIMD_X86_FILE_HEADER
@@ -0,0 +1,590 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+// Tile row bands on worker threads
+//
+// Every tile of an image is decoded / encoded from its own fixed ROM
+// offset, so an image can be cut into bands of whole tile rows which
+// don't share any state. The bands run on a GLib thread pool, the
+// calling thread takes the first one itself.
+//
+// Batches of images (rom_bin_jobs_*) run on a work stealing scheduler
+// instead: every worker thread has its own deque of tasks, which it
+// pushes to and pops from at the bottom while idle workers steal from
+// the top. An image decoded / encoded on a worker queues its bands on
+// that deque, so the bands of a big image get spread over the workers
+// which would otherwise sit idle, rather than holding up the batch.
+
+#include "lib_rom_bin.h"
+#include "rom_threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+
+// One band of tile rows, handed to a pool thread
+typedef struct rom_band_job {
+    romimg_band_fn p_band_fn;
+    void         * p_ctx;
+    int            band;
+    int            first_row;
+    int            row_count;
+} rom_band_job;
+
+
+// Tasks with the same group are waited for together
+typedef struct rom_task_group {
+    gint pending;                  // tasks not finished yet
+} rom_task_group;
+
+typedef struct rom_task {
+    romimg_task_fn   p_task_fn;
+    void           * p_ctx;
+    rom_task_group * p_group;
+} rom_task;
+
+// Ring buffer of tasks, grown as needed. Tasks are whole bands or images,
+// so a lock per queue costs next to nothing compared to running them
+typedef struct rom_task_queue {
+    GMutex     lock;
+    rom_task * p_tasks;
+    int        capacity;
+    int        first;              // the top (oldest) task
+    int        count;
+} rom_task_queue;
+
+typedef struct rom_sched_worker {
+    GThread      * p_thread;
+    int            index;
+    rom_task_queue deque;
+} rom_sched_worker;
+
+
+static int thread_count = -1;
+
+static rom_sched_worker * sched_workers      = NULL;
+static int                sched_worker_count = 0;
+static rom_task_queue     sched_submitted;           // jobs from rom_bin_jobs_submit(), oldest first
+static rom_task_group     sched_jobs;
+static gint               sched_queued       = 0;    // tasks waiting in any of the queues (only
+                                                     // changed with the queue's lock held)
+static int                sched_stopping     = 0;
+
+// Idle workers and waiting threads sleep on these
+static GMutex             sched_lock;
+static GCond              sched_work_cond;           // tasks were queued, or the workers should stop
+static GCond              sched_done_cond;           // a task group finished
+
+static GPrivate           sched_current_worker = G_PRIVATE_INIT(NULL);
+
+
+
+// Returns the number of threads to use for one image: one per processor
+// core, or the number set with the ROM_BIN_THREADS environment variable
+int romimg_thread_count_get(void)
+{
+    const char * p_env;
+    char       * p_end;
+    long int     count;
+
+    if (thread_count > 0)
+        return thread_count;
+
+    thread_count = (int)g_get_num_processors();
+
+    p_env = getenv(ROMIMG_THREADS_ENV_VAR);
+    if ((p_env != NULL) && (*p_env != '\0')) {
+
+        count = strtol(p_env, &p_end, 10);
+
+        if ((p_end != p_env) && (*p_end == '\0') && (count > 0) && (count <= 1024))
+            thread_count = (int)count;
+        else
+            printf("%s: bad thread count \"%s\", using %d\n", ROMIMG_THREADS_ENV_VAR,
+                   p_env, thread_count);
+    }
+
+    if (thread_count < 1)
+        thread_count = 1;
+
+    return thread_count;
+}
+
+
+
+// Returns how many bands to split an image of tile_rows rows of
+// tiles_per_row tiles into, so each thread gets a worthwhile amount of work
+int romimg_band_count(int tile_rows, int tiles_per_row)
+{
+    long int bands;
+
+    if ((tile_rows <= 0) || (tiles_per_row <= 0))
+        return 1;
+
+    bands = ((long int)tile_rows * tiles_per_row) / ROMIMG_BAND_MIN_TILES;
+
+    if (bands > romimg_thread_count_get())
+        bands = romimg_thread_count_get();
+    if (bands > tile_rows)
+        bands = tile_rows;
+    if (bands < 1)
+        bands = 1;
+
+    return (int)bands;
+}
+
+
+
+static void band_job_run(gpointer p_data, gpointer p_user_data)
+{
+    rom_band_job * p_job = (rom_band_job *)p_data;
+
+    (void)p_user_data;
+
+    p_job->p_band_fn(p_job->band, p_job->first_row, p_job->row_count, p_job->p_ctx);
+}
+
+
+
+static void task_queue_init(rom_task_queue * p_queue)
+{
+    g_mutex_init(&p_queue->lock);
+    p_queue->p_tasks  = NULL;
+    p_queue->capacity = 0;
+    p_queue->first    = 0;
+    p_queue->count    = 0;
+}
+
+
+static void task_queue_clear(rom_task_queue * p_queue)
+{
+    g_mutex_clear(&p_queue->lock);
+    free(p_queue->p_tasks);
+    p_queue->p_tasks = NULL;
+}
+
+
+// Adds a task at the bottom of the queue, returns -1 if there's no memory for it
+static int task_queue_push(rom_task_queue * p_queue, const rom_task * p_task)
+{
+    rom_task * p_tasks;
+    int t, capacity;
+
+    g_mutex_lock(&p_queue->lock);
+
+    if (p_queue->count == p_queue->capacity) {
+
+        capacity = (p_queue->capacity > 0) ? (p_queue->capacity * 2) : 64;
+
+        if (NULL == (p_tasks = malloc(capacity * sizeof(rom_task)))) {
+            g_mutex_unlock(&p_queue->lock);
+            return -1;
+        }
+
+        // Unwrap the ring into the new buffer
+        for (t=0; t < p_queue->count; t++)
+            p_tasks[t] = p_queue->p_tasks[(p_queue->first + t) % p_queue->capacity];
+
+        free(p_queue->p_tasks);
+        p_queue->p_tasks  = p_tasks;
+        p_queue->capacity = capacity;
+        p_queue->first    = 0;
+    }
+
+    p_queue->p_tasks[(p_queue->first + p_queue->count) % p_queue->capacity] = *p_task;
+    p_queue->count++;
+    g_atomic_int_inc(&sched_queued);
+
+    g_mutex_unlock(&p_queue->lock);
+
+    return 0;
+}
+
+
+// Takes the bottom (newest) task, only if it belongs to p_group when that's set.
+// Returns 1 if it got a task
+static int task_queue_pop_bottom(rom_task_queue * p_queue, rom_task * p_task, const rom_task_group * p_group)
+{
+    rom_task * p_bottom;
+    int found = 0;
+
+    g_mutex_lock(&p_queue->lock);
+
+    if (p_queue->count > 0) {
+        p_bottom = &p_queue->p_tasks[(p_queue->first + p_queue->count - 1) % p_queue->capacity];
+
+        if ((NULL == p_group) || (p_bottom->p_group == p_group)) {
+            *p_task = *p_bottom;
+            p_queue->count--;
+            g_atomic_int_add(&sched_queued, -1);
+            found = 1;
+        }
+    }
+
+    g_mutex_unlock(&p_queue->lock);
+
+    return found;
+}
+
+
+// Takes the top (oldest) task, returns 1 if it got one
+static int task_queue_pop_top(rom_task_queue * p_queue, rom_task * p_task)
+{
+    int found = 0;
+
+    g_mutex_lock(&p_queue->lock);
+
+    if (p_queue->count > 0) {
+        *p_task = p_queue->p_tasks[p_queue->first];
+        p_queue->first = (p_queue->first + 1) % p_queue->capacity;
+        p_queue->count--;
+        g_atomic_int_add(&sched_queued, -1);
+        found = 1;
+    }
+
+    g_mutex_unlock(&p_queue->lock);
+
+    return found;
+}
+
+
+
+// Wakes up the idle workers after tasks were queued
+static void sched_notify_workers(void)
+{
+    g_mutex_lock(&sched_lock);
+    g_cond_broadcast(&sched_work_cond);
+    g_mutex_unlock(&sched_lock);
+}
+
+
+static void sched_task_run(rom_task * p_task)
+{
+    rom_task_group * p_group = p_task->p_group;
+
+    p_task->p_task_fn(p_task->p_ctx);
+
+    if (g_atomic_int_dec_and_test(&p_group->pending)) {
+        g_mutex_lock(&sched_lock);
+        g_cond_broadcast(&sched_done_cond);
+        g_mutex_unlock(&sched_lock);
+    }
+}
+
+
+// Blocks until all the tasks of a group have finished
+static void sched_group_wait(rom_task_group * p_group)
+{
+    g_mutex_lock(&sched_lock);
+
+    while (g_atomic_int_get(&p_group->pending) > 0)
+        g_cond_wait(&sched_done_cond, &sched_lock);
+
+    g_mutex_unlock(&sched_lock);
+}
+
+
+// Next task for a worker: its own newest one, else the oldest one of
+// another worker (the bands of an image started elsewhere), else the
+// oldest submitted job. Returns 1 if it found one
+static int sched_find_task(rom_sched_worker * p_worker, rom_task * p_task)
+{
+    int w;
+
+    if (task_queue_pop_bottom(&p_worker->deque, p_task, NULL))
+        return 1;
+
+    for (w=1; w < sched_worker_count; w++) {
+        if (task_queue_pop_top(&sched_workers[(p_worker->index + w) % sched_worker_count].deque, p_task))
+            return 1;
+    }
+
+    return task_queue_pop_top(&sched_submitted, p_task);
+}
+
+
+static gpointer sched_worker_run(gpointer p_data)
+{
+    rom_sched_worker * p_worker = (rom_sched_worker *)p_data;
+    rom_task task;
+
+    g_private_set(&sched_current_worker, p_worker);
+
+    for (;;) {
+        if (sched_find_task(p_worker, &task)) {
+            sched_task_run(&task);
+            continue;
+        }
+
+        // Nothing to do, sleep until something gets queued
+        g_mutex_lock(&sched_lock);
+
+        while (!sched_stopping && (0 == g_atomic_int_get(&sched_queued)))
+            g_cond_wait(&sched_work_cond, &sched_lock);
+
+        if (sched_stopping && (0 == g_atomic_int_get(&sched_queued))) {
+            g_mutex_unlock(&sched_lock);
+            break;
+        }
+
+        g_mutex_unlock(&sched_lock);
+    }
+
+    return NULL;
+}
+
+
+
+// Starts worker_count worker threads (0: romimg_thread_count_get()) for
+// romimg_sched_submit(). Returns the number started, -1 if they can't be
+int romimg_sched_start(int worker_count)
+{
+    GError * p_error = NULL;
+    int w, started;
+
+    if (sched_worker_count > 0)
+        return -1;
+
+    // Also settles the thread count before the workers look at it
+    if (worker_count < 1)
+        worker_count = romimg_thread_count_get();
+    else
+        romimg_thread_count_get();
+
+    if (NULL == (sched_workers = calloc(worker_count, sizeof(rom_sched_worker))))
+        return -1;
+
+    task_queue_init(&sched_submitted);
+    for (w=0; w < worker_count; w++) {
+        sched_workers[w].index = w;
+        task_queue_init(&sched_workers[w].deque);
+    }
+
+    g_atomic_int_set(&sched_jobs.pending, 0);
+    sched_stopping     = 0;
+    sched_worker_count = worker_count;
+
+    for (started=0; started < worker_count; started++) {
+
+        sched_workers[started].p_thread = g_thread_try_new("rom-bin-worker", sched_worker_run,
+                                                           &sched_workers[started], &p_error);
+        if (NULL == sched_workers[started].p_thread)
+            break;
+    }
+
+    if (started < worker_count) {
+        if (p_error != NULL) {
+            printf("Couldn't start worker threads: %s\n", p_error->message);
+            g_error_free(p_error);
+        }
+
+        // Stop the ones which did start
+        g_mutex_lock(&sched_lock);
+        sched_stopping = 1;
+        g_cond_broadcast(&sched_work_cond);
+        g_mutex_unlock(&sched_lock);
+
+        for (w=0; w < started; w++)
+            g_thread_join(sched_workers[w].p_thread);
+
+        for (w=0; w < worker_count; w++)
+            task_queue_clear(&sched_workers[w].deque);
+        task_queue_clear(&sched_submitted);
+
+        free(sched_workers);
+        sched_workers      = NULL;
+        sched_worker_count = 0;
+        return -1;
+    }
+
+    return worker_count;
+}
+
+
+// Queues a job for the workers, or runs it right away if they aren't started
+void romimg_sched_submit(romimg_task_fn p_task_fn, void * p_ctx)
+{
+    rom_task task;
+
+    task.p_task_fn = p_task_fn;
+    task.p_ctx     = p_ctx;
+    task.p_group   = &sched_jobs;
+
+    g_atomic_int_inc(&sched_jobs.pending);
+
+    if ((0 == sched_worker_count) || (0 != task_queue_push(&sched_submitted, &task))) {
+        sched_task_run(&task);
+        return;
+    }
+
+    sched_notify_workers();
+}
+
+
+// Blocks until all submitted jobs have finished
+void romimg_sched_wait(void)
+{
+    sched_group_wait(&sched_jobs);
+}
+
+
+// Finishes the queued jobs, then stops the worker threads
+void romimg_sched_stop(void)
+{
+    int w;
+
+    if (0 == sched_worker_count)
+        return;
+
+    g_mutex_lock(&sched_lock);
+    sched_stopping = 1;
+    g_cond_broadcast(&sched_work_cond);
+    g_mutex_unlock(&sched_lock);
+
+    for (w=0; w < sched_worker_count; w++)
+        g_thread_join(sched_workers[w].p_thread);
+
+    for (w=0; w < sched_worker_count; w++)
+        task_queue_clear(&sched_workers[w].deque);
+    task_queue_clear(&sched_submitted);
+
+    free(sched_workers);
+    sched_workers      = NULL;
+    sched_worker_count = 0;
+}
+
+
+
+static void band_task_run(void * p_data)
+{
+    band_job_run(p_data, NULL);
+}
+
+
+// Runs the bands on a scheduler worker: queues them on its deque for idle
+// workers to steal, takes the first one itself, then the ones nobody stole
+static void sched_run_bands(rom_sched_worker * p_worker, rom_band_job * p_jobs, int band_count)
+{
+    rom_task_group group;
+    rom_task task;
+    int band, queued = 0;
+
+    g_atomic_int_set(&group.pending, band_count - 1);
+
+    for (band=1; band < band_count; band++) {
+
+        task.p_task_fn = band_task_run;
+        task.p_ctx     = &p_jobs[band];
+        task.p_group   = &group;
+
+        if (0 == task_queue_push(&p_worker->deque, &task))
+            queued = 1;
+        else
+            sched_task_run(&task);
+    }
+
+    if (queued)
+        sched_notify_workers();
+
+    band_task_run(&p_jobs[0]);
+
+    while (task_queue_pop_bottom(&p_worker->deque, &task, &group))
+        sched_task_run(&task);
+
+    // Wait for the stolen ones
+    sched_group_wait(&group);
+}
+
+
+
+// Splits tile_rows rows into band_count bands of (nearly) the same size
+// and runs p_band_fn on each of them, returns once they've all finished
+//
+// Falls back to running the bands one after another if the threads can't be started
+void romimg_run_bands(romimg_band_fn p_band_fn, void * p_ctx, int tile_rows, int band_count)
+{
+    rom_band_job     * p_jobs;
+    rom_sched_worker * p_worker;
+    GThreadPool      * p_pool = NULL;
+    GError           * p_error = NULL;
+    int band, first_row;
+
+    if (band_count > tile_rows)
+        band_count = tile_rows;
+
+    if (band_count <= 1) {
+        p_band_fn(0, 0, tile_rows, p_ctx);
+        return;
+    }
+
+    p_jobs = malloc(band_count * sizeof(rom_band_job));
+
+    // Spread the remainder rows over the first bands
+    first_row = 0;
+    for (band=0; (p_jobs != NULL) && (band < band_count); band++) {
+        p_jobs[band].p_band_fn = p_band_fn;
+        p_jobs[band].p_ctx     = p_ctx;
+        p_jobs[band].band      = band;
+        p_jobs[band].first_row = first_row;
+        p_jobs[band].row_count = (tile_rows / band_count) + ((band < (tile_rows % band_count)) ? 1 : 0);
+
+        first_row += p_jobs[band].row_count;
+    }
+
+    // Already on a batch worker, share the bands with the other workers
+    p_worker = (rom_sched_worker *)g_private_get(&sched_current_worker);
+
+    if ((p_jobs != NULL) && (p_worker != NULL)) {
+        sched_run_bands(p_worker, p_jobs, band_count);
+        free(p_jobs);
+        return;
+    }
+
+    if (p_jobs != NULL)
+        p_pool = g_thread_pool_new(band_job_run, NULL, band_count - 1, FALSE, &p_error);
+
+    if (p_pool == NULL) {
+        if (p_error != NULL) {
+            printf("Couldn't start worker threads: %s\n", p_error->message);
+            g_error_free(p_error);
+        }
+
+        // Do it all on this thread instead
+        if (p_jobs == NULL)
+            p_band_fn(0, 0, tile_rows, p_ctx);
+        else
+            for (band=0; band < band_count; band++)
+                band_job_run(&p_jobs[band], NULL);
+
+        free(p_jobs);
+        return;
+    }
+
+    // Hand out the other bands, then take the first one on this thread
+    for (band=1; band < band_count; band++)
+        g_thread_pool_push(p_pool, &p_jobs[band], NULL);
+
+    band_job_run(&p_jobs[0], NULL);
+
+    // Wait for the pool threads to finish their bands
+    g_thread_pool_free(p_pool, FALSE, TRUE);
+
+    free(p_jobs);
+}
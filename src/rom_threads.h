@@ -0,0 +1,46 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - X
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+
+#ifndef ROM_THREADS_FILE_HEADER
+#define ROM_THREADS_FILE_HEADER
+
+// Set this in the environment to change the number of worker threads
+// used to decode / encode an image (default: one per processor core)
+#define ROMIMG_THREADS_ENV_VAR    "ROM_BIN_THREADS"
+
+// Bands smaller than this many tiles aren't worth handing to another thread
+#define ROMIMG_BAND_MIN_TILES     2048
+
+    // Processes tile rows first_row to first_row + row_count - 1 of an image.
+    // Bands are independent of each other and may run at the same time
+    typedef void (*romimg_band_fn)(int band, int first_row, int row_count, void * p_ctx);
+
+    // A job run by the work stealing scheduler
+    typedef void (*romimg_task_fn)(void * p_ctx);
+
+    int romimg_thread_count_get(void);
+    int romimg_band_count(int, int);
+    void romimg_run_bands(romimg_band_fn, void *, int, int);
+
+    int romimg_sched_start(int);
+    void romimg_sched_submit(romimg_task_fn, void *);
+    void romimg_sched_wait(void);
+    void romimg_sched_stop(void);
+
+#endif // ROM_THREADS_FILE_HEADER
@@ -22,6 +22,30 @@
 #include <string.h>
 
 
+// Bitplane expansion table: bit 7 of the index goes to byte 0 of the entry, bit 0 to byte 7
+#define BITPLANE_LUT_ENTRY(n) ( ((((uint64_t)(n)) >> 7) & 0x01)        | \
+                                (((((uint64_t)(n)) >> 6) & 0x01) <<  8) | \
+                                (((((uint64_t)(n)) >> 5) & 0x01) << 16) | \
+                                (((((uint64_t)(n)) >> 4) & 0x01) << 24) | \
+                                (((((uint64_t)(n)) >> 3) & 0x01) << 32) | \
+                                (((((uint64_t)(n)) >> 2) & 0x01) << 40) | \
+                                (((((uint64_t)(n)) >> 1) & 0x01) << 48) | \
+                                (((((uint64_t)(n)) >> 0) & 0x01) << 56) )
+
+#define BITPLANE_LUT_4(n)   BITPLANE_LUT_ENTRY(n), BITPLANE_LUT_ENTRY((n) + 1), \
+                            BITPLANE_LUT_ENTRY((n) + 2), BITPLANE_LUT_ENTRY((n) + 3)
+#define BITPLANE_LUT_16(n)  BITPLANE_LUT_4(n), BITPLANE_LUT_4((n) + 4), \
+                            BITPLANE_LUT_4((n) + 8), BITPLANE_LUT_4((n) + 12)
+#define BITPLANE_LUT_64(n)  BITPLANE_LUT_16(n), BITPLANE_LUT_16((n) + 16), \
+                            BITPLANE_LUT_16((n) + 32), BITPLANE_LUT_16((n) + 48)
+
+const uint64_t romimg_bitplane_lut[256] = {
+    BITPLANE_LUT_64(0),   BITPLANE_LUT_64(64),
+    BITPLANE_LUT_64(128), BITPLANE_LUT_64(192)
+};
+
+
+
 void romimg_log_transparent_tiles(unsigned int transparency_flag, unsigned int * p_empty_tile_count, app_gfx_data * p_app_gfx, rom_gfx_attrib rom_attrib)
 {
     // Transparent pixels in a tile indicate that this is
@@ -46,22 +70,54 @@ void romimg_log_transparent_pixel(unsigned char * p_image_pixel, unsigned int *
 }
 
 
-void romimg_set_decoded_pixel_and_advance(unsigned char ** pp_image_pixel, unsigned char pixel_val, unsigned char is_transparent, app_gfx_data * p_app_gfx)
+void romimg_set_decoded_row_and_advance(unsigned char ** pp_image_pixel, uint64_t row_pixels, unsigned char is_transparent, app_gfx_data * p_app_gfx)
 {
-    // Set the image pixel
-    **pp_image_pixel = pixel_val;
+    unsigned char * p_image_pixel;
+    unsigned char   alpha;
+    int b;
+
+    // Unpack a tile row of 8 pixels (leftmost pixel in the lowest byte)
+    // Alpha handling is checked once per row instead of once per pixel
+    p_image_pixel = *pp_image_pixel;
+
+    // Pixels past the end of valid rom data are blanked
+    if (is_transparent)
+        row_pixels = 0;
 
-    // If the image has an transparency alpha mask
-    // then set transparency as needed
     if (BIN_BITDEPTH_INDEXED_ALPHA == p_app_gfx->bytes_per_pixel) {
-        if (is_transparent)
-            *(*(pp_image_pixel) + 1) = 0;   // Set Alpha mask byte to TRANSPARENT (pixel does not contain valid rom data)
-        else
-            *(*(pp_image_pixel) + 1) = 255; // Set Alpha mask byte to VISIBLE (pixel stores valid rom data)
+
+        // Alpha mask byte: TRANSPARENT if pixel does not contain valid rom data
+        alpha = (is_transparent) ? 0 : 255;
+
+        for (b=0; b < 8; b++) {
+            *(p_image_pixel++) = (unsigned char)(row_pixels >> (b * 8));
+            *(p_image_pixel++) = alpha;
+        }
+    }
+    else {
+        for (b=0; b < 8; b++)
+            *(p_image_pixel++) = (unsigned char)(row_pixels >> (b * 8));
     }
 
-    // Advance to next pixel in the buffer factoring in bytes depth
-    *pp_image_pixel += p_app_gfx->bytes_per_pixel;
+    *pp_image_pixel = p_image_pixel;
+}
+
+
+void romimg_set_transparent_tile(unsigned char * p_image_pixel, app_gfx_data * p_app_gfx, rom_gfx_attrib rom_attrib)
+{
+    unsigned char * p_row;
+    unsigned int ty;
+
+    // Fill a whole tile which is past the end of valid ROM data
+    // with transparent pixels, top to bottom
+    for (ty=0; ty < rom_attrib.TILE_PIXEL_HEIGHT; ty++) {
+
+        p_row = p_image_pixel + (ty * p_app_gfx->width * p_app_gfx->bytes_per_pixel);
+        romimg_set_decoded_row_and_advance(&p_row,
+                                           0,
+                                           1,
+                                           p_app_gfx);
+    }
 }
 
 
@@ -76,11 +132,59 @@ unsigned char * romimg_calc_appimg_offset(int x, int y, int tile_y, app_gfx_data
 
 
 
+// Copies tile_count tiles stored one after another (tile-major: what the
+// tile kernels write for an image one tile wide) to consecutive tiles
+// of the image, starting at the top-left pixel p_image_pixel
+void romimg_copy_tiles_to_image(const unsigned char * p_tiles, int tile_count, unsigned char * p_image_pixel, app_gfx_data * p_app_gfx, rom_gfx_attrib rom_attrib)
+{
+    const unsigned char * p_src;
+    unsigned char       * p_dst;
+    long int tile_row_bytes, tile_bytes, image_stride;
+    unsigned int ty;
+    int t;
+
+    tile_row_bytes = rom_attrib.TILE_PIXEL_WIDTH * p_app_gfx->bytes_per_pixel;
+    tile_bytes     = tile_row_bytes * rom_attrib.TILE_PIXEL_HEIGHT;
+    image_stride   = p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+
+    // One image row at a time, so the writes are sequential
+    for (ty=0; ty < rom_attrib.TILE_PIXEL_HEIGHT; ty++) {
+
+        p_src = p_tiles + (ty * tile_row_bytes);
+        p_dst = p_image_pixel + (ty * image_stride);
+
+        // Constant sizes for the usual 8 pixel rows, so the copies become plain moves
+        if (8 == tile_row_bytes) {
+            for (t=0; t < tile_count; t++, p_src += tile_bytes, p_dst += 8)
+                memcpy(p_dst, p_src, 8);
+        }
+        else if (16 == tile_row_bytes) {
+            for (t=0; t < tile_count; t++, p_src += tile_bytes, p_dst += 16)
+                memcpy(p_dst, p_src, 16);
+        }
+        else {
+            for (t=0; t < tile_count; t++, p_src += tile_bytes, p_dst += tile_row_bytes)
+                memcpy(p_dst, p_src, tile_row_bytes);
+        }
+    }
+}
+
+
+
+long int romimg_calc_tile_size_bytes(rom_gfx_attrib rom_attrib)
+{
+    // Tiles are NxN pixels. Calculate size factoring in pixel bit-packing.
+    // (multiply first: 3bpp tiles aren't a whole number of pixels per byte)
+    return (((long int)rom_attrib.TILE_PIXEL_WIDTH * rom_attrib.TILE_PIXEL_HEIGHT) * rom_attrib.BITS_PER_PIXEL) / 8;
+}
+
+
+
 long int romimg_calc_encoded_size(app_gfx_data * p_app_gfx, rom_gfx_attrib rom_attrib)
 {
     long int size;
 
-    size = (p_app_gfx->width * p_app_gfx->height) / (8 / rom_attrib.BITS_PER_PIXEL);
+    size = (((long int)p_app_gfx->width * p_app_gfx->height) * rom_attrib.BITS_PER_PIXEL) / 8;
 
     return(size);
 }
@@ -109,13 +213,19 @@ void romimg_calc_decoded_size(long int file_size,  app_gfx_data * p_app_gfx, rom
 
     // First calculate the number of tiles in the image
 
-    // Tiles are NxN pixels. Calculate size factoring in pixel bit-packing.
     int tile_size_bytes;
     int tiles;
     long int surplus_bytes_count;
+    unsigned int image_width;
+
+    // Callers can ask for a width (a multiple of the tile width) by setting it
+    // beforehand, rom_bin_init_structs() leaves it at 0 for the default
+    image_width = rom_attrib.IMAGE_WIDTH_DEFAULT;
 
-    tile_size_bytes = ((rom_attrib.TILE_PIXEL_WIDTH * rom_attrib.TILE_PIXEL_HEIGHT)
-                             / (8 / rom_attrib.BITS_PER_PIXEL));
+    if ((p_app_gfx->width > 0) && (0 == (p_app_gfx->width % rom_attrib.TILE_PIXEL_WIDTH)))
+        image_width = p_app_gfx->width;
+
+    tile_size_bytes = romimg_calc_tile_size_bytes(rom_attrib);
 
     // Calculate number of tiles, as well as number of bytes left over
     tiles = file_size / tile_size_bytes;
@@ -126,25 +236,24 @@ void romimg_calc_decoded_size(long int file_size,  app_gfx_data * p_app_gfx, rom
 
     // Now calculate Width & Height
 
-    // * Width: if less than 128 pixels wide worth of
-    //          tiles, then use cumulative tile width.
+    // * Width: if less than 128 pixels (or the requested width) wide
+    //          worth of tiles, then use cumulative tile width.
     //          Otherwise default to 128 (8 tiles)
-    if ((tiles * rom_attrib.TILE_PIXEL_WIDTH) < rom_attrib.IMAGE_WIDTH_DEFAULT) {
+    if ((tiles * rom_attrib.TILE_PIXEL_WIDTH) < image_width) {
         // Use number of tiles x size as the width
         p_app_gfx->width = (tiles * rom_attrib.TILE_PIXEL_WIDTH);
     }
     else
     {
-        // TODO: It would be nice if width was selectable (as a multiple of tile width)
-        p_app_gfx->width = 128;
+        p_app_gfx->width = image_width;
     }
 
 
 
     // * Height is a function of width, tile height and number of tiles
     //   Round up: Integer rounding up: (x + (n-1)) / n
-    p_app_gfx->height = (((tiles * rom_attrib.TILE_PIXEL_WIDTH) + (rom_attrib.IMAGE_WIDTH_DEFAULT - 1))
-                         / rom_attrib.IMAGE_WIDTH_DEFAULT);
+    p_app_gfx->height = (((tiles * rom_attrib.TILE_PIXEL_WIDTH) + (image_width - 1))
+                         / image_width);
 
     // Now scale up by the tile height
     p_app_gfx->height *= rom_attrib.TILE_PIXEL_HEIGHT;
@@ -152,8 +261,68 @@ void romimg_calc_decoded_size(long int file_size,  app_gfx_data * p_app_gfx, rom
     // If there are extra bytes left over then flag them
     // as needing to be stored in metadata as a gimp parasite
     p_app_gfx->surplus_bytes_size = surplus_bytes_count;
+}
+
 
-    printf("extra bytes %ld\n", p_app_gfx->surplus_bytes_size);
+
+// Sets empty_tile_count for a decoded image: the tiles which don't have a
+// whole tile of rom data left for them (always at the end of the image)
+void romimg_count_empty_tiles(long int rom_size, app_gfx_data * p_app_gfx, rom_gfx_attrib rom_attrib)
+{
+    long int tile_count, data_tile_count;
+
+    tile_count = (long int)(p_app_gfx->width  / rom_attrib.TILE_PIXEL_WIDTH)
+                         * (p_app_gfx->height / rom_attrib.TILE_PIXEL_HEIGHT);
+
+    data_tile_count = rom_size / romimg_calc_tile_size_bytes(rom_attrib);
+
+    if (data_tile_count >= tile_count)
+        p_app_gfx->empty_tile_count = 0;
+    else
+        p_app_gfx->empty_tile_count = tile_count - data_tile_count;
+}
+
+
+
+// Hashes each tile of row_count image rows (whole tile rows) into p_hashes,
+// in the order the tiles get encoded. Used to spot changed tiles, so it only
+// needs to be fast and to mix well, not to be cryptographic. Export still
+// compares the tiles with matching hashes against the file before skipping them
+void romimg_hash_tiles(const unsigned char * p_rows, int row_count, uint64_t * p_hashes,
+                       app_gfx_data * p_app_gfx, rom_gfx_attrib rom_attrib)
+{
+    const unsigned char * p_tile_row;
+    long int image_stride, tile_row_bytes, x;
+    unsigned int tile_x, tile_y, y, tiles_per_row;
+    uint64_t hash, word;
+
+    image_stride   = (long int)p_app_gfx->width * p_app_gfx->bytes_per_pixel;
+    tile_row_bytes = (long int)rom_attrib.TILE_PIXEL_WIDTH * p_app_gfx->bytes_per_pixel;
+    tiles_per_row  = p_app_gfx->width / rom_attrib.TILE_PIXEL_WIDTH;
+
+    for (tile_y = 0; tile_y < (unsigned int)row_count; tile_y += rom_attrib.TILE_PIXEL_HEIGHT) {
+        for (tile_x = 0; tile_x < tiles_per_row; tile_x++) {
+
+            hash = 0x243F6A8885A308D3ULL;
+
+            for (y = 0; y < rom_attrib.TILE_PIXEL_HEIGHT; y++) {
+                p_tile_row = p_rows + ((tile_y + y) * image_stride) + (tile_x * tile_row_bytes);
+
+                // 8 bytes at a time (one 8 pixel row without alpha), then any left over
+                for (x = 0; x + 8 <= tile_row_bytes; x += 8) {
+                    memcpy(&word, p_tile_row + x, sizeof(word));
+                    hash  = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+                    hash ^= hash >> 29;
+                }
+                for (; x < tile_row_bytes; x++) {
+                    hash  = (hash ^ p_tile_row[x]) * 0x9E3779B97F4A7C15ULL;
+                    hash ^= hash >> 29;
+                }
+            }
+
+            *p_hashes++ = hash;
+        }
+    }
 }
 
 
@@ -162,8 +331,6 @@ int romimg_stash_surplus_bytes(app_gfx_data * p_app_gfx, rom_gfx_data * p_rom_gf
 {
     if (p_app_gfx->surplus_bytes_size > 0) {
 
-        printf("Saving extra bytes %ld\n", p_app_gfx->surplus_bytes_size);
-
         // Set aside any surplus bytes at the end which weren't decoded as tiles
         // These will get attached to the gimp image as metadata parasite
         if (NULL == (p_app_gfx->p_surplus_bytes = malloc(p_app_gfx->surplus_bytes_size)) )
@@ -179,40 +346,21 @@ int romimg_stash_surplus_bytes(app_gfx_data * p_app_gfx, rom_gfx_data * p_rom_gf
 }
 
 
+// Appends the surplus bytes right after the encoded tiles. The rom buffer
+// must have been allocated with room for them (see romimg_format_encode)
 int romimg_append_surplus_bytes(app_gfx_data * p_app_gfx, rom_gfx_data * p_rom_gfx)
 {
-    long int        new_size;
-    unsigned char * p_new_rom_data = NULL;
+    long int new_size;
 
     if (p_app_gfx->surplus_bytes_size > 0) {
 
-        printf("Appending extra bytes %ld\n", p_app_gfx->surplus_bytes_size);
-
-        // Allocate a new buffer with the size of the others combined
         new_size = p_rom_gfx->size + p_app_gfx->surplus_bytes_size;
 
-        if (NULL == (p_new_rom_data = malloc(new_size)))
-            return -1;
-
-        printf("Size:  rom=%ld, surplus=%ld, newrom=%ld\n", p_rom_gfx->size,
-                                                          p_app_gfx->surplus_bytes_size,
-                                                          new_size);
-
-        // Copy the contents of the main buffer into the new one
-        memcpy(p_new_rom_data,
-               p_rom_gfx->p_data,
-               p_rom_gfx->size);
-
-        // Append the contents of the surplus buffer into the END of the new one
-        memcpy(p_new_rom_data + p_rom_gfx-> size,
+        // Copy the surplus bytes in after the end of the tile data
+        memcpy(p_rom_gfx->p_data + p_rom_gfx->size,
                p_app_gfx->p_surplus_bytes,
                p_app_gfx->surplus_bytes_size);
 
-        // Free the old rom buffer
-        free(p_rom_gfx->p_data);
-
-        // Swap the new buffer into the struct
-        p_rom_gfx->p_data = p_new_rom_data;
         p_rom_gfx->size = new_size;
     }
 
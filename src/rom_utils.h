@@ -22,15 +22,28 @@
 
 #include "lib_rom_bin.h"
 
+#include <stdint.h>
+
+    // Expands one bitplane byte (MS bit = leftmost pixel) into 8 pixels,
+    // one per byte of the word (leftmost pixel in the lowest byte) with the
+    // bit set in position 0. Shift left by N for bitplane N.
+    extern const uint64_t romimg_bitplane_lut[256];
+
     void romimg_log_transparent_tiles(unsigned int , unsigned int *, app_gfx_data *, rom_gfx_attrib);
     void romimg_log_transparent_pixel(unsigned char *, unsigned int *,  app_gfx_data *);
-    void romimg_set_decoded_pixel_and_advance(unsigned char **, unsigned char, unsigned char, app_gfx_data *);
+    void romimg_set_decoded_row_and_advance(unsigned char **, uint64_t, unsigned char, app_gfx_data *);
+    void romimg_set_transparent_tile(unsigned char *, app_gfx_data *, rom_gfx_attrib);
 
     unsigned char * romimg_calc_appimg_offset(int, int, int, app_gfx_data *, rom_gfx_attrib);
+    void romimg_copy_tiles_to_image(const unsigned char *, int, unsigned char *, app_gfx_data *, rom_gfx_attrib);
 
+    long int romimg_calc_tile_size_bytes(rom_gfx_attrib);
     long int romimg_calc_encoded_size(app_gfx_data *, rom_gfx_attrib);
     void romimg_calc_decoded_size(long int, app_gfx_data *, rom_gfx_attrib);
 
+    void romimg_count_empty_tiles(long int, app_gfx_data *, rom_gfx_attrib);
+    void romimg_hash_tiles(const unsigned char *, int, uint64_t *, app_gfx_data *, rom_gfx_attrib);
+
     int romimg_stash_surplus_bytes(app_gfx_data *, rom_gfx_data *);
     int romimg_append_surplus_bytes(app_gfx_data *, rom_gfx_data *);
 
@@ -0,0 +1,211 @@
+/*=======================================================================
+              ROM bin load / save plugin for the GIMP
+                 Copyright 2018 - Others & Nathan Osman (webp plugin base)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+=======================================================================*/
+
+// Per tile hashes of the rom data, kept in an image parasite
+//
+// Import stores a hash of every tile as it was decoded from the file. Export
+// in patch in place mode hashes the tiles again and only encodes and writes
+// back the ones which changed, then stores the new hashes for the next time.
+// The hashes are only used for the file they came from, with the same format,
+// pixel depth and image width, and only while the file still has the size and
+// modification time it had when they were stored.
+
+#include "tile-hashes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <libgimp/gimp.h>
+
+#define TILE_HASHES_PARASITE "ROM-BIN-TILE-HASHES"
+
+// Parasite layout: header, then the hashes, then the file name (with its NUL)
+typedef struct tile_hashes_header {
+    int64_t  file_size;
+    int64_t  file_mtime;
+    uint32_t image_mode;
+    uint32_t bytes_per_pixel;
+    uint32_t width;
+    uint32_t tile_count;
+    uint32_t filename_size;
+    uint32_t file_mtime_nsec;    // 0 where the file system / platform doesn't have them
+} tile_hashes_header;
+
+
+
+// Gets the size and modification time of a file into the header,
+// returns -1 if the file can't be found
+static int get_file_stamp(const gchar * filename, tile_hashes_header * p_header)
+{
+    struct stat file_stat;
+
+    if (0 != stat(filename, &file_stat))
+        return -1;
+
+    p_header->file_size       = (int64_t)file_stat.st_size;
+    p_header->file_mtime      = (int64_t)file_stat.st_mtime;
+    p_header->file_mtime_nsec = 0;
+
+    // Seconds alone miss a same size rewrite by another tool within the same second
+    #if defined(__APPLE__)
+        p_header->file_mtime_nsec = (uint32_t)file_stat.st_mtimespec.tv_nsec;
+    #elif defined(st_mtime)
+        // st_mtime is a macro for st_mtim.tv_sec where stat has nanoseconds (glibc, musl, BSD)
+        p_header->file_mtime_nsec = (uint32_t)file_stat.st_mtim.tv_nsec;
+    #endif
+
+    return 0;
+}
+
+
+
+// Allocates room for the hashes of every tile of an image of
+// height rows, sets *p_tile_count. Returns NULL on failure
+uint64_t * tile_hashes_alloc(app_gfx_data * p_app_gfx, int height, long int * p_tile_count)
+{
+    long int tile_size_bytes;
+
+    tile_size_bytes = rom_bin_tile_size_bytes(p_app_gfx->image_mode);
+    if (tile_size_bytes <= 0)
+        return NULL;
+
+    *p_tile_count = rom_bin_encoded_rows_size(p_app_gfx, height) / tile_size_bytes;
+    if (*p_tile_count <= 0)
+        return NULL;
+
+    return malloc(*p_tile_count * sizeof(uint64_t));
+}
+
+
+
+// Stores the tile hashes of an image, for the rom file filename as it is now
+void tile_hashes_attach(gint32 image_id, const gchar * filename, app_gfx_data * p_app_gfx,
+                        const uint64_t * p_hashes, long int tile_count)
+{
+    GimpParasite     * parasite;
+    tile_hashes_header header;
+    unsigned char    * p_data;
+    size_t             hashes_size, data_size;
+
+    memset(&header, 0, sizeof(header));
+
+    // Without a stamp there'd be no telling if the file changed, so drop any old hashes
+    if (0 != get_file_stamp(filename, &header)) {
+        gimp_image_detach_parasite(image_id, TILE_HASHES_PARASITE);
+        return;
+    }
+
+    header.image_mode      = (uint32_t)p_app_gfx->image_mode;
+    header.bytes_per_pixel = p_app_gfx->bytes_per_pixel;
+    header.width           = p_app_gfx->width;
+    header.tile_count      = (uint32_t)tile_count;
+    header.filename_size   = (uint32_t)strlen(filename) + 1;
+
+    hashes_size = (size_t)tile_count * sizeof(uint64_t);
+    data_size   = sizeof(header) + hashes_size + header.filename_size;
+
+    if (NULL == (p_data = malloc(data_size)))
+        return;
+
+    memcpy(p_data, &header, sizeof(header));
+    memcpy(p_data + sizeof(header), p_hashes, hashes_size);
+    memcpy(p_data + sizeof(header) + hashes_size, filename, header.filename_size);
+
+    parasite = gimp_parasite_new(TILE_HASHES_PARASITE,
+                                 GIMP_PARASITE_PERSISTENT,
+                                 data_size,
+                                 p_data);
+    gimp_image_attach_parasite(image_id,
+                               parasite);
+    gimp_parasite_free(parasite);
+
+    free(p_data);
+}
+
+
+
+// Returns a copy of the stored tile hashes (free() it) and sets *p_tile_count,
+// or NULL if there are none that match the rom file and image. Hashes for a
+// file which was changed since they were stored (size or modification time)
+// are thrown away, the tiles in it may not be the ones they describe any more
+uint64_t * tile_hashes_get(gint32 image_id, const gchar * filename, app_gfx_data * p_app_gfx, long int * p_tile_count)
+{
+    GimpParasite       * img_parasite;
+    tile_hashes_header   header, file_header;
+    const unsigned char * p_data;
+    uint64_t           * p_hashes = NULL;
+    size_t               hashes_size;
+
+    img_parasite = gimp_image_get_parasite(image_id,
+                                           TILE_HASHES_PARASITE);
+    if (!img_parasite)
+        return NULL;
+
+    p_data = img_parasite->data;
+
+    if (0 != get_file_stamp(filename, &file_header)) {
+        gimp_parasite_free(img_parasite);
+        return NULL;
+    }
+
+    if (img_parasite->size >= sizeof(header)) {
+
+        memcpy(&header, p_data, sizeof(header));
+        hashes_size = (size_t)header.tile_count * sizeof(uint32_t);
+
+        if ((img_parasite->size == sizeof(header) + hashes_size + header.filename_size) &&
+            (header.file_size       == file_header.file_size) &&
+            (header.file_mtime      == file_header.file_mtime) &&
+            (header.file_mtime_nsec == file_header.file_mtime_nsec) &&
+            (header.image_mode      == (uint32_t)p_app_gfx->image_mode) &&
+            (header.bytes_per_pixel == p_app_gfx->bytes_per_pixel) &&
+            (header.width           == p_app_gfx->width) &&
+            (header.filename_size   == strlen(filename) + 1) &&
+            (0 == memcmp(p_data + sizeof(header) + hashes_size, filename, header.filename_size)) &&
+            (NULL != (p_hashes = malloc(hashes_size + 1)))) {
+
+            memcpy(p_hashes, p_data + sizeof(header), hashes_size);
+            *p_tile_count = header.tile_count;
+        }
+    }
+
+    gimp_parasite_free(img_parasite);
+
+    return p_hashes;
+}
+
+
+
+// Copies the tile hashes from one image to another (ex: from an
+// export copy back to the image that was being edited)
+void tile_hashes_copy(gint32 from_image_id, gint32 to_image_id)
+{
+    GimpParasite * img_parasite;
+
+    if (from_image_id == to_image_id)
+        return;
+
+    img_parasite = gimp_image_get_parasite(from_image_id,
+                                           TILE_HASHES_PARASITE);
+    if (img_parasite) {
+        gimp_image_attach_parasite(to_image_id,
+                                   img_parasite);
+        gimp_parasite_free(img_parasite);
+    }
+}
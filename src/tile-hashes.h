@@ -1,8 +1,6 @@
 /*=======================================================================
               ROM bin load / save plugin for the GIMP
-                 Copyright 2018 - X
-
-                 Useful : https://www.rpi.edu/dept/acm/packages/gimp/gimp-1.2.3/plug-ins/common/pcx.c
+                 Copyright 2018 - Others & Nathan Osman (webp plugin base)
 
  This program is free software: you can redistribute it and/or modify
  it under the terms of the GNU General Public License as published by
@@ -18,6 +16,17 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 =======================================================================*/
 
+#ifndef TILE_HASHES_FILE_HEADER
+#define TILE_HASHES_FILE_HEADER
+
+#include "lib_rom_bin.h"
+
+#include <stdint.h>
+#include <glib.h>
+
+uint64_t * tile_hashes_alloc(app_gfx_data *, int, long int *);
+void tile_hashes_attach(gint32, const gchar *, app_gfx_data *, const uint64_t *, long int);
+uint64_t * tile_hashes_get(gint32, const gchar *, app_gfx_data *, long int *);
+void tile_hashes_copy(gint32, gint32);
 
-int bin_decode_nes_1bpp(rom_gfx_data *, app_gfx_data *, app_color_data *);
-int bin_encode_nes_1bpp(rom_gfx_data *, app_gfx_data *);
\ No newline at end of file
+#endif // TILE_HASHES_FILE_HEADER
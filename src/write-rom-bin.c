@@ -17,34 +17,473 @@
 =======================================================================*/
 
 #include "write-rom-bin.h"
+#include "read-rom-bin.h"
 #include "lib_rom_bin.h"
+#include "tile-hashes.h"
+#include "rom_file.h"
+#include "rom_patch.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <libgimp/gimp.h>
 
-int write_rom_bin(const gchar * filename, gint image_id, gint drawable_id, int image_mode)
+// The drawable is read, encoded and written out in strips of this many
+// GIMP tile rows (64 pixels each), so memory use doesn't grow with the image size
+#define WRITE_STRIP_GIMP_TILE_ROWS    64
+
+// Writes the bytes stored in an image parasite (if it has one) at the
+// current file position and adds their count to *p_file_size
+static int write_parasite_bytes(FILE * file, gint image_id, const gchar * parasite_name, long int * p_file_size)
 {
-    int status;
+    GimpParasite * img_parasite;
+    int status = 0;
 
-    GimpDrawable * drawable;
-    GimpPixelRgn rgn;
+    img_parasite = gimp_image_get_parasite(image_id,
+                                           parasite_name);
+
+    if (img_parasite) {
+
+        if (img_parasite->size > 0) {
+            if (1 != fwrite(img_parasite->data, img_parasite->size, 1, file))
+                status = -1;
+
+            *p_file_size += img_parasite->size;
+        }
+
+        gimp_parasite_free(img_parasite);
+    }
+
+    return status;
+}
+
+
+// Gets the part of the file the image was loaded from, the size the file had
+// then and the format it was decoded with (*p_image_mode, optional), returns
+// -1 if the image doesn't have one recorded
+static int get_file_window(gint image_id, long int * p_offset, long int * p_length, long int * p_file_size,
+                           int * p_image_mode)
+{
+    GimpParasite * img_parasite;
+    int image_mode;
+    int status = -1;
+
+    img_parasite = gimp_image_get_parasite(image_id,
+                                           "ROM-BIN-WINDOW");
+
+    if (img_parasite) {
+
+        // Text parasite, "offset length file_size image_mode" with a terminating NUL
+        if ((img_parasite->size > 0) &&
+            ('\0' == ((const char *)img_parasite->data)[img_parasite->size - 1]) &&
+            (4 == sscanf(img_parasite->data, "%ld %ld %ld %d", p_offset, p_length, p_file_size, &image_mode)) &&
+            (*p_offset >= 0) && (*p_length >= 0) && (*p_file_size >= (*p_offset + *p_length)))
+            status = 0;
+
+        if ((0 == status) && (NULL != p_image_mode))
+            *p_image_mode = image_mode;
+
+        gimp_parasite_free(img_parasite);
+    }
+
+    return status;
+}
+
+
+// Gets the size of the bytes stored in an image parasite, 0 if it doesn't have one
+static long int get_parasite_size(gint image_id, const gchar * parasite_name)
+{
+    GimpParasite * img_parasite;
+    long int size = 0;
+
+    img_parasite = gimp_image_get_parasite(image_id,
+                                           parasite_name);
+
+    if (img_parasite) {
+        size = img_parasite->size;
+        gimp_parasite_free(img_parasite);
+    }
+
+    return size;
+}
+
+
+// Returns the name of the rom file the image was loaded from (g_free() it), NULL if unknown
+static gchar * get_source_filename(gint image_id)
+{
     GimpParasite * img_parasite;
+    gchar * p_filename = NULL;
+
+    img_parasite = gimp_image_get_parasite(image_id,
+                                           "ROM-BIN-SOURCE-FILE");
+
+    if (img_parasite) {
+
+        if ((img_parasite->size > 1) &&
+            ('\0' == ((const char *)img_parasite->data)[img_parasite->size - 1]))
+            p_filename = g_strdup(img_parasite->data);
+
+        gimp_parasite_free(img_parasite);
+    }
+
+    return p_filename;
+}
+
+
+// Reads the bytes of the rom file the image was loaded from which were before
+// and after the loaded part into p_prefix and p_suffix (free() them), so export
+// can rebuild the whole file. They're read before the file gets written, since
+// it can be the same one. Both are left empty for images of a whole file.
+//
+// Returns -1 if the file can't be read or its size changed since the image was loaded
+static int read_file_surround(gint image_id, rom_gfx_data * p_prefix, rom_gfx_data * p_suffix)
+{
+    gchar  * p_source_filename;
+    long int window_offset, window_length, file_size, suffix_offset;
+    int      status = 0;
+
+    p_prefix->p_data = NULL;
+    p_prefix->size   = 0;
+    p_suffix->p_data = NULL;
+    p_suffix->size   = 0;
+
+    // Nothing around it if the image isn't from part of a rom file
+    if (0 != get_file_window(image_id, &window_offset, &window_length, &file_size, NULL))
+        return 0;
+
+    suffix_offset = window_offset + window_length;
+
+    if ((0 == window_offset) && (suffix_offset == file_size))
+        return 0;
+
+    if (NULL == (p_source_filename = get_source_filename(image_id))) {
+        printf("Export: the rom file the image was loaded from isn't known\n");
+        return -1;
+    }
+
+    if (romimg_file_size(p_source_filename) != file_size) {
+        printf("Export: %s is missing or changed size since the image was loaded from it\n", p_source_filename);
+        g_free(p_source_filename);
+        return -1;
+    }
+
+    if ((window_offset > 0) &&
+        ((0 != romimg_file_read_range(p_source_filename, 0, window_offset, p_prefix)) ||
+         (p_prefix->size != window_offset)))
+        status = -1;
+
+    if ((0 == status) && (suffix_offset < file_size) &&
+        ((0 != romimg_file_read_range(p_source_filename, suffix_offset, file_size - suffix_offset, p_suffix)) ||
+         (p_suffix->size != (file_size - suffix_offset))))
+        status = -1;
+
+    if (0 != status) {
+        printf("Export: can't read the rest of %s\n", p_source_filename);
+        free(p_prefix->p_data);
+        free(p_suffix->p_data);
+        p_prefix->p_data = NULL;
+        p_prefix->size   = 0;
+        p_suffix->p_data = NULL;
+        p_suffix->size   = 0;
+    }
+
+    g_free(p_source_filename);
+
+    return status;
+}
 
+
+// Returns TRUE if both names are the same file (the same name,
+// or another path to it where the file system has inode numbers)
+static int is_same_file(const gchar * filename, const gchar * other_filename)
+{
+    struct stat file_stat, other_stat;
+
+    if (0 == strcmp(filename, other_filename))
+        return TRUE;
+
+    return ((0 == stat(filename, &file_stat)) &&
+            (0 == stat(other_filename, &other_stat)) &&
+            (0 != file_stat.st_ino) &&
+            (file_stat.st_dev == other_stat.st_dev) &&
+            (file_stat.st_ino == other_stat.st_ino));
+}
+
+
+// Opens the rom file an image was loaded from for patching in place and
+// moves to the start of the loaded part. *p_window_tiles_size is set to
+// the number of bytes of tile data in that part (before the surplus bytes)
+static FILE * open_file_window(const gchar * filename, gint image_id, int image_mode, long int tile_size_bytes,
+                               long int * p_window_offset, long int * p_window_tiles_size)
+{
     FILE * file;
+    gchar * p_source_filename;
+    long int window_length, file_size;
+    int window_image_mode;
+    int is_source;
+
+    if (0 != get_file_window(image_id, p_window_offset, &window_length, &file_size, &window_image_mode)) {
+        printf("Patch in place: no loaded file region recorded for the image\n");
+        return NULL;
+    }
+
+    // The region is only known for the file the image came from, writing
+    // it into any other file would overwrite whatever is there (code, data)
+    p_source_filename = get_source_filename(image_id);
+    is_source         = (NULL != p_source_filename) && is_same_file(filename, p_source_filename);
+
+    if (!is_source) {
+        printf("Patch in place: %s isn't the file the image was loaded from (%s)\n",
+               filename, p_source_filename ? p_source_filename : "unknown");
+        g_free(p_source_filename);
+        return NULL;
+    }
+
+    g_free(p_source_filename);
+
+    // Tiles encoded in another format would overwrite the region with different data
+    if (window_image_mode != image_mode) {
+        printf("Patch in place: the image was loaded as %s, not %s\n",
+               rom_bin_format_name(window_image_mode), rom_bin_format_name(image_mode));
+        return NULL;
+    }
+
+    // The surplus bytes go after the tile data, so the tiles have to fill the rest
+    *p_window_tiles_size = window_length - get_parasite_size(image_id, "ROM-BIN-SURPLUS-BYTES");
+
+    if ((*p_window_tiles_size < 0) || (0 != (*p_window_tiles_size % tile_size_bytes))) {
+        printf("Patch in place: the loaded file region doesn't match the tile format\n");
+        return NULL;
+    }
+
+    // Open for update, the file is never truncated
+    file = fopen(filename, "r+b");
+    if (!file)
+        return NULL;
+
+    if ((0 != fseek(file, 0, SEEK_END)) ||
+        (ftell(file) != file_size)) {
+        printf("Patch in place: %s changed size since the image was loaded from it\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    if (0 != fseek(file, *p_window_offset, SEEK_SET)) {
+        fclose(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+
+
+// Returns TRUE if every pixel of the tile at tile_x of a row of tiles
+// (image rows with alpha) is transparent
+static int is_empty_tile(const unsigned char * p_rows, unsigned int width, int tile_x,
+                         unsigned int tile_width, int tile_height)
+{
+    const unsigned char * p_pixel;
+    unsigned int x;
+    int y;
+
+    for (y = 0; y < tile_height; y++) {
+
+        p_pixel = p_rows + (((long int)y * width) + ((long int)tile_x * tile_width)) * BIN_BITDEPTH_INDEXED_ALPHA;
+
+        for (x = 0; x < tile_width; x++, p_pixel += BIN_BITDEPTH_INDEXED_ALPHA) {
+            if (0 != *(p_pixel + 1))
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+// Checks that the image tiles fit in the tile data of the loaded region
+// before anything gets patched. Every tile past it (padding from the load,
+// or from the image being made bigger) has to be empty: fully transparent,
+// so an image without alpha can't run past the region at all
+static int check_fits_window(GimpPixelRgn * p_rgn, app_gfx_data * p_app_gfx, int tile_rows_height, int tile_height,
+                             long int window_tiles_size, unsigned char * p_strip)
+{
+    rom_gfx_attrib attrib;
+    long int       tiles_size, tile_size_bytes, tiles_per_tile_row, first_tile, tile;
+    int            row, tile_x;
+
+    tiles_size = rom_bin_encoded_rows_size(p_app_gfx, tile_rows_height);
+
+    if (tiles_size <= window_tiles_size)
+        return 0;
+
+    if ((BIN_BITDEPTH_INDEXED_ALPHA != p_app_gfx->bytes_per_pixel) ||
+        (0 != rom_bin_format_attrib(p_app_gfx->image_mode, &attrib))) {
+        printf("Patch in place: image has %ld bytes of tiles, more than the %ld loaded\n",
+               tiles_size, window_tiles_size);
+        return -1;
+    }
+
+    tile_size_bytes    = rom_bin_tile_size_bytes(p_app_gfx->image_mode);
+    tiles_per_tile_row = rom_bin_encoded_rows_size(p_app_gfx, tile_height) / tile_size_bytes;
+
+    // The region always holds whole tiles, so this is the first tile past it
+    first_tile = window_tiles_size / tile_size_bytes;
+
+    for (row = (int)(first_tile / tiles_per_tile_row) * tile_height; row < tile_rows_height; row += tile_height) {
+
+        gimp_pixel_rgn_get_rect(p_rgn,
+                                p_strip,
+                                0, row,
+                                p_app_gfx->width, tile_height);
+
+        tile = (row / tile_height) * tiles_per_tile_row;
+
+        for (tile_x = 0; tile_x < tiles_per_tile_row; tile_x++, tile++) {
+
+            if ((tile >= first_tile) &&
+                !is_empty_tile(p_strip, p_app_gfx->width, tile_x, attrib.TILE_PIXEL_WIDTH, tile_height)) {
+                printf("Patch in place: image has tiles past the %ld bytes loaded (tile %ld isn't empty)\n",
+                       window_tiles_size, tile);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+// Patches the tiles of a strip which changed into the loaded region of the
+// file, leaving the rest of it untouched. A tile whose hash differs from the
+// one in p_old_hashes has changed, one whose hash matches is compared with
+// the tile in the file before it gets skipped, so a hash collision can't lose
+// an edit. Runs of changed tiles are written at once
+static int patch_changed_tiles(FILE * file, app_gfx_data * p_app_gfx, int strip_y, int strip_rows,
+                               unsigned char * p_strip, unsigned char * p_strip_rom,
+                               const uint64_t * p_hashes, const uint64_t * p_old_hashes, long int old_tile_count,
+                               long int window_offset, long int window_tiles_size)
+{
+    long int        tile_size_bytes, tiles_per_tile_row, first_tile, tile, file_tile_count;
+    long int        run_start, row_offset, row_size;
+    int             tile_height, row;
+    unsigned int    empty_tile_count;
+    unsigned char * p_file_tiles;
+    unsigned char * p_changed;
+    int             status = 0;
+
+    tile_height        = rom_bin_tile_height(p_app_gfx->image_mode);
+    tile_size_bytes    = rom_bin_tile_size_bytes(p_app_gfx->image_mode);
+    tiles_per_tile_row = rom_bin_encoded_rows_size(p_app_gfx, tile_height) / tile_size_bytes;
+
+    // One row of tiles as it is in the file, and which of them changed
+    p_file_tiles = malloc(tiles_per_tile_row * tile_size_bytes);
+    p_changed    = malloc(tiles_per_tile_row);
+
+    if ((NULL == p_file_tiles) || (NULL == p_changed))
+        status = -1;
+
+    for (row = strip_y; (0 == status) && (row < (strip_y + strip_rows)); row += tile_height) {
+
+        first_tile = (row / tile_height) * tiles_per_tile_row;
+
+        // Nothing goes past the tile data of the loaded region
+        row_offset = first_tile * tile_size_bytes;
+        row_size   = tiles_per_tile_row * tile_size_bytes;
+
+        if (row_size > (window_tiles_size - row_offset))
+            row_size = window_tiles_size - row_offset;
+
+        if (row_size <= 0)
+            break;
+
+        file_tile_count = row_size / tile_size_bytes;
+
+        empty_tile_count = 0;
+        if ((0 != rom_bin_encode_rows(p_app_gfx,
+                                      row,
+                                      tile_height,
+                                      p_strip + ((long int)(row - strip_y) * p_app_gfx->width * p_app_gfx->bytes_per_pixel),
+                                      p_strip_rom,
+                                      &empty_tile_count)) ||
+            (0 != fseek(file, window_offset + row_offset, SEEK_SET)) ||
+            (1 != fread(p_file_tiles, row_size, 1, file))) {
+            status = -1;
+            break;
+        }
+
+        for (tile = 0; tile < file_tile_count; tile++)
+            p_changed[tile] = ((first_tile + tile) >= old_tile_count) ||
+                              (p_hashes[first_tile + tile] != p_old_hashes[first_tile + tile]) ||
+                              (0 != memcmp(p_strip_rom  + tile * tile_size_bytes,
+                                           p_file_tiles + tile * tile_size_bytes,
+                                           tile_size_bytes));
+
+        tile = 0;
+        while ((0 == status) && (tile < file_tile_count)) {
+
+            // Skip the unchanged tiles, then write the next run of changed ones
+            while ((tile < file_tile_count) && !p_changed[tile])
+                tile++;
+
+            run_start = tile;
+            while ((tile < file_tile_count) && p_changed[tile])
+                tile++;
+
+            if ((tile > run_start) &&
+                ((0 != fseek(file, window_offset + row_offset + run_start * tile_size_bytes, SEEK_SET)) ||
+                 (1 != fwrite(p_strip_rom + run_start * tile_size_bytes, (tile - run_start) * tile_size_bytes, 1, file))))
+                status = -1;
+        }
+    }
+
+    free(p_file_tiles);
+    free(p_changed);
+
+    return status;
+}
+
 
-    status = 0; // Default to success
+// Exports the drawable as rom tile data. Normally the whole file is written,
+// copying the bytes around the tile data from the file it was loaded from.
+// With patch_in_place only the tile data and surplus bytes are written over
+// the part of the existing file the image was loaded from, the rest of the
+// file is left untouched.
+int write_rom_bin(const gchar * filename, gint image_id, gint drawable_id, int image_mode, int patch_in_place)
+{
+    GimpDrawable * drawable;
+    GimpPixelRgn rgn;
+
+    FILE * file;
 
     app_gfx_data   app_gfx;
     app_color_data colorpal; // TODO: rename to app_colorpal?
     rom_gfx_data   rom_gfx;
+    rom_gfx_data   prefix, suffix;
+
+    unsigned char * p_strip;
+    unsigned char * p_strip_rom;
+    unsigned int    empty_tile_count;
+    long int        rom_size, tile_size_bytes, strip_rom_size, strip_write_size;
+    long int        window_offset, window_tiles_size;
+    uint64_t      * p_tile_hashes, * p_old_tile_hashes;
+    long int        tile_count, old_tile_count, tiles_per_tile_row;
+    int             tile_height, tile_rows_height, strip_rows, strip_y;
+    int             status;
 
     rom_bin_init_structs(&rom_gfx, &app_gfx, &colorpal);
 
     app_gfx.image_mode = image_mode;
 
+    tile_height     = rom_bin_tile_height(image_mode);
+    tile_size_bytes = rom_bin_tile_size_bytes(image_mode);
+
+    if ((tile_height <= 0) || (tile_size_bytes <= 0))
+        return 0;
+
 
     // Get the drawable
     drawable = gimp_drawable_get(drawable_id);
@@ -53,11 +492,42 @@ int write_rom_bin(const gchar * filename, gint image_id, gint drawable_id, int i
     app_gfx.bytes_per_pixel = (unsigned char)gimp_drawable_bpp(drawable_id);
 
     // Abort if it's not 1 or 2 bytes per pixel
-    // TODO: handle both 1 (no alpha) and 2 (has alpha) byte-per-pixel mode
     if (app_gfx.bytes_per_pixel >= BIN_BITDEPTH_LAST) {
+        gimp_drawable_detach(drawable);
+        return 0;
+    }
+
+    app_gfx.width  = drawable->width;
+    app_gfx.height = drawable->height;
+
+    // Only whole rows of tiles get encoded
+    tile_rows_height = app_gfx.height - (app_gfx.height % tile_height);
+
+    if (0 >= rom_bin_encoded_rows_size(&app_gfx, tile_rows_height)) {
+        gimp_drawable_detach(drawable);
         return 0;
     }
 
+    // Strips are a whole number of GIMP tile rows, rounded down to whole rom tile rows
+    strip_rows  = gimp_tile_height() * WRITE_STRIP_GIMP_TILE_ROWS;
+    strip_rows -= strip_rows % tile_height;
+
+    if (strip_rows < tile_height)
+        strip_rows = tile_height;
+    if (strip_rows > tile_rows_height)
+        strip_rows = tile_rows_height;
+
+    p_strip     = malloc((size_t)app_gfx.width * strip_rows * app_gfx.bytes_per_pixel);
+    p_strip_rom = malloc(rom_bin_encoded_rows_size(&app_gfx, strip_rows));
+
+    if ((NULL == p_strip) || (NULL == p_strip_rom)) {
+        free(p_strip);
+        free(p_strip_rom);
+        gimp_drawable_detach(drawable);
+        return 0;
+    }
+
+
     // Get a pixel region from the layer
     gimp_pixel_rgn_init(&rgn,
                         drawable,
@@ -66,79 +536,386 @@ int write_rom_bin(const gchar * filename, gint image_id, gint drawable_id, int i
                         drawable->height,
                         FALSE, FALSE);
 
+    // Open the file
+    window_offset     = 0;
+    window_tiles_size = 0;
+
+    prefix.p_data = NULL;
+    prefix.size   = 0;
+    suffix.p_data = NULL;
+    suffix.size   = 0;
+
+    if (patch_in_place) {
+        file = open_file_window(filename, image_id, image_mode, tile_size_bytes,
+                                &window_offset, &window_tiles_size);
+
+        if ((NULL != file) &&
+            (0 != check_fits_window(&rgn, &app_gfx, tile_rows_height, tile_height,
+                                    window_tiles_size, p_strip))) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+    else if (0 == read_file_surround(image_id, &prefix, &suffix))
+        file = fopen(filename, "wb");
+    else
+        file = NULL;
 
-    // Determine the array size for the app's image then allocate it
-    app_gfx.width   = drawable->width;
-    app_gfx.height  = drawable->height;
-    app_gfx.size    =  drawable->width * drawable->height * app_gfx.bytes_per_pixel;
-    app_gfx.p_data  = malloc(app_gfx.size);
+    if(!file)
+    {
+        free(prefix.p_data);
+        free(suffix.p_data);
+        free(p_strip);
+        free(p_strip_rom);
+        gimp_drawable_detach(drawable);
+        return 0;
+    }
 
-    // Get the image data
-    gimp_pixel_rgn_get_rect(&rgn,
-                            app_gfx.p_data,
-                            0, 0,
-                            drawable->width,
-                            drawable->height);
 
+    // Hash the tiles as they get written. When patching the file they were
+    // loaded from (or last written to), the hashes stored with the image
+    // say which tiles are already there
+    p_tile_hashes      = tile_hashes_alloc(&app_gfx, tile_rows_height, &tile_count);
+    tiles_per_tile_row = (NULL != p_tile_hashes) ? tile_count / (tile_rows_height / tile_height) : 0;
 
+    p_old_tile_hashes = NULL;
+    old_tile_count    = 0;
 
-    // TODO: move parasite metadata handling into a function?
-    img_parasite = gimp_image_get_parasite(image_id,
-                                           "ROM-BIN-SURPLUS-BYTES");
+    if (patch_in_place && (NULL != p_tile_hashes))
+        p_old_tile_hashes = tile_hashes_get(image_id, filename, &app_gfx, &old_tile_count);
 
-    if (img_parasite) {
-        printf("Found parasite size %d\n", img_parasite->size);
 
-        // Load surplus (non-encodable) bytes stashed in the gimp metadata parasite
-        app_gfx.surplus_bytes_size = img_parasite->size;
+    // If the image came from part of a rom file,
+    // restore the bytes which were before that part first
+    status = 0;
+
+    if ((prefix.size > 0) && (1 != fwrite(prefix.p_data, prefix.size, 1, file)))
+        status = -1;
+
+    // Read a strip from the drawable, encode it and write it out, then
+    // move on to the next one. Writes go through the OS file cache, so
+    // they get flushed to disk while the next strips are encoding
+    rom_size         = 0;
+    empty_tile_count = 0;
+
+    for (strip_y = 0; (0 == status) && (strip_y < tile_rows_height); strip_y += strip_rows) {
+
+        if (strip_rows > (tile_rows_height - strip_y))
+            strip_rows = tile_rows_height - strip_y;
+
+        gimp_pixel_rgn_get_rect(&rgn,
+                                p_strip,
+                                0, strip_y,
+                                app_gfx.width, strip_rows);
 
-        if (NULL == (app_gfx.p_surplus_bytes = malloc(app_gfx.surplus_bytes_size)) ) {
-            // TODO: handle and centralize freeing these buffers better
-            free(app_gfx.p_data);
-            free(app_gfx.p_surplus_bytes);
-            free(rom_gfx.p_data);
-            return 0;
+        if ((NULL != p_tile_hashes) &&
+            (0 != rom_bin_hash_tiles(&app_gfx,
+                                     strip_rows,
+                                     p_strip,
+                                     p_tile_hashes + (strip_y / tile_height) * tiles_per_tile_row))) {
+            status = -1;
+            break;
         }
 
-        memcpy(app_gfx.p_surplus_bytes,
-               (unsigned char *)img_parasite->data,
-               img_parasite->size);
-    }
+        // When the tiles already in the file are known, only the changed ones get patched
+        if (NULL != p_old_tile_hashes) {
+            if (0 != patch_changed_tiles(file, &app_gfx, strip_y, strip_rows, p_strip, p_strip_rom,
+                                         p_tile_hashes, p_old_tile_hashes, old_tile_count,
+                                         window_offset, window_tiles_size)) {
+                status = -1;
+                break;
+            }
+            continue;
+        }
 
+        strip_rom_size   = rom_bin_encoded_rows_size(&app_gfx, strip_rows);
+        strip_write_size = strip_rom_size;
 
+        // When patching, nothing gets written past the tile data of the loaded region
+        if (patch_in_place) {
+            if (strip_write_size > (window_tiles_size - rom_size))
+                strip_write_size = window_tiles_size - rom_size;
+            if (strip_write_size < 0)
+                strip_write_size = 0;
+        }
 
-    status = rom_bin_encode(&rom_gfx,
-                            &app_gfx);
-    // TODO: Check colormap size and throw a warning if it's too large (4bpp vs 2bpp, etc)
-    if (status != 0) { };
+        if ((0 != rom_bin_encode_rows(&app_gfx,
+                                      strip_y,
+                                      strip_rows,
+                                      p_strip,
+                                      p_strip_rom,
+                                      &empty_tile_count)) ||
+            ((strip_write_size > 0) &&
+             (1 != fwrite(p_strip_rom, strip_write_size, 1, file)))) {
+            status = -1;
+            break;
+        }
 
+        rom_size += strip_rom_size;
+    }
 
-    // Free the image data
-    free(app_gfx.p_data);
-    free(app_gfx.p_surplus_bytes);
+    free(p_strip);
+    free(p_strip_rom);
+    free(p_old_tile_hashes);
 
     // Detach the drawable
     gimp_drawable_detach(drawable);
 
-    // Make sure that the write was successful
-    if(rom_gfx.size == FALSE)
-    {
-        free(rom_gfx.p_data);
+
+    // Substract transparent/empty tiles from rom image file size
+    // (tiles past the end of the rom data when it was loaded)
+    rom_size -= empty_tile_count * tile_size_bytes;
+
+    if (rom_size < 0)
+        rom_size = 0;
+
+    if (patch_in_place) {
+
+        // The surplus bytes go back after the tile data, which ends the region
+        // (tiles past the region were checked to be empty before patching)
+        if ((0 == status) && (0 != fseek(file, window_offset + window_tiles_size, SEEK_SET)))
+            status = -1;
+
+        if (0 == status)
+            status = write_parasite_bytes(file, image_id, "ROM-BIN-SURPLUS-BYTES", &rom_size);
+    }
+    else {
+
+        // From here on rom_size is the size of the whole file
+        rom_size += prefix.size;
+
+        if ((0 == status) && (0 != fflush(file)))
+            status = -1;
+
+        if ((0 == status) && (0 != fseek(file, rom_size, SEEK_SET)))
+            status = -1;
+
+        // Write the surplus (non-encodable) bytes stashed in the gimp metadata
+        // parasite straight after the trimmed tile data, then the bytes which
+        // were after the loaded part of the rom file (if only part was loaded)
+        if (0 == status)
+            status = write_parasite_bytes(file, image_id, "ROM-BIN-SURPLUS-BYTES", &rom_size);
+
+        if ((0 == status) && (suffix.size > 0)) {
+            if (1 != fwrite(suffix.p_data, suffix.size, 1, file))
+                status = -1;
+
+            rom_size += suffix.size;
+        }
+
+        // Drop the trimmed tiles which were already written past the new end
+        if ((0 == status) && (0 != fflush(file)))
+            status = -1;
+
+        if ((0 == status) && (0 != ftruncate(fileno(file), rom_size)))
+            status = -1;
+    }
+
+    if (0 != fclose(file))
+        status = -1;
+
+    free(prefix.p_data);
+    free(suffix.p_data);
+
+    // The tile data can have grown or shrunk, so the file now has a different
+    // size and its suffix moved. Export and patch from here on go by this file
+    if ((0 == status) && !patch_in_place)
+        file_window_attach(image_id, filename, prefix.size, rom_size - prefix.size - suffix.size,
+                           rom_size, image_mode);
+
+    // The file now holds these tiles, the next patch only needs to write the ones changed after this
+    if (NULL != p_tile_hashes) {
+        if (0 == status)
+            tile_hashes_attach(image_id, filename, &app_gfx, p_tile_hashes, tile_count);
+        free(p_tile_hashes);
+    }
+
+    return (0 == status) ? 1 : 0;
+}
+
+
+
+// Encodes the whole drawable into p_rom_gfx (malloc'd), trimming the empty
+// tiles at the end and adding the surplus bytes, the same as export writes it
+static int encode_drawable(gint image_id, gint drawable_id, int image_mode, rom_gfx_data * p_rom_gfx)
+{
+    GimpDrawable * drawable;
+    GimpPixelRgn   rgn;
+    GimpParasite * img_parasite;
+
+    app_gfx_data   app_gfx;
+    app_color_data colorpal;
+
+    unsigned char * p_strip;
+    unsigned int    empty_tile_count;
+    long int        tile_size_bytes, tiles_size, surplus_size;
+    int             tile_height, tile_rows_height, strip_rows, strip_y;
+    int             status = 0;
+
+    rom_bin_init_structs(p_rom_gfx, &app_gfx, &colorpal);
+
+    app_gfx.image_mode = image_mode;
+
+    tile_height     = rom_bin_tile_height(image_mode);
+    tile_size_bytes = rom_bin_tile_size_bytes(image_mode);
+
+    if ((tile_height <= 0) || (tile_size_bytes <= 0))
+        return -1;
+
+    drawable = gimp_drawable_get(drawable_id);
+
+    app_gfx.bytes_per_pixel = (unsigned char)gimp_drawable_bpp(drawable_id);
+    app_gfx.width           = drawable->width;
+    app_gfx.height          = drawable->height;
+
+    tile_rows_height = app_gfx.height - (app_gfx.height % tile_height);
+    tiles_size       = rom_bin_encoded_rows_size(&app_gfx, tile_rows_height);
+
+    if ((app_gfx.bytes_per_pixel >= BIN_BITDEPTH_LAST) || (tiles_size <= 0)) {
+        gimp_drawable_detach(drawable);
+        return -1;
+    }
+
+    strip_rows  = gimp_tile_height() * WRITE_STRIP_GIMP_TILE_ROWS;
+    strip_rows -= strip_rows % tile_height;
+
+    if (strip_rows < tile_height)
+        strip_rows = tile_height;
+    if (strip_rows > tile_rows_height)
+        strip_rows = tile_rows_height;
+
+    img_parasite = gimp_image_get_parasite(image_id,
+                                           "ROM-BIN-SURPLUS-BYTES");
+    surplus_size = img_parasite ? img_parasite->size : 0;
+
+    p_strip            = malloc((size_t)app_gfx.width * strip_rows * app_gfx.bytes_per_pixel);
+    p_rom_gfx->p_data  = malloc(tiles_size + surplus_size);
+
+    if ((NULL == p_strip) || (NULL == p_rom_gfx->p_data))
+        status = -1;
+
+    gimp_pixel_rgn_init(&rgn,
+                        drawable,
+                        0, 0,
+                        drawable->width,
+                        drawable->height,
+                        FALSE, FALSE);
+
+    empty_tile_count = 0;
+
+    for (strip_y = 0; (0 == status) && (strip_y < tile_rows_height); strip_y += strip_rows) {
+
+        if (strip_rows > (tile_rows_height - strip_y))
+            strip_rows = tile_rows_height - strip_y;
+
+        gimp_pixel_rgn_get_rect(&rgn,
+                                p_strip,
+                                0, strip_y,
+                                app_gfx.width, strip_rows);
+
+        if (0 != rom_bin_encode_rows(&app_gfx,
+                                     strip_y,
+                                     strip_rows,
+                                     p_strip,
+                                     p_rom_gfx->p_data + rom_bin_encoded_rows_size(&app_gfx, strip_y),
+                                     &empty_tile_count))
+            status = -1;
+    }
+
+    free(p_strip);
+    gimp_drawable_detach(drawable);
+
+    if (0 == status) {
+
+        // Substract transparent/empty tiles, then the surplus bytes go after the tiles
+        p_rom_gfx->size = tiles_size - (long int)empty_tile_count * tile_size_bytes;
+        if (p_rom_gfx->size < 0)
+            p_rom_gfx->size = 0;
+
+        if (surplus_size > 0) {
+            memcpy(p_rom_gfx->p_data + p_rom_gfx->size, img_parasite->data, surplus_size);
+            p_rom_gfx->size += surplus_size;
+        }
+    }
+    else {
+        free(p_rom_gfx->p_data);
+        p_rom_gfx->p_data = NULL;
+    }
+
+    if (img_parasite)
+        gimp_parasite_free(img_parasite);
+
+    return status;
+}
+
+
+
+// Exports the drawable as a patch (IPS or BPS) for the rom file the image
+// was loaded from, instead of as the rom file itself. The patch turns that
+// file into what a regular export would have written
+int write_rom_patch(const gchar * filename, gint image_id, gint drawable_id, int image_mode, int patch_format)
+{
+    FILE * file;
+
+    rom_gfx_data     tiles, source_rom;
+    rom_file_source  source;
+    rom_patch_target target;
+
+    gchar * p_source_filename;
+    long int window_offset, window_length, file_size;
+    int window_image_mode;
+    int status;
+
+    if ((NULL == (p_source_filename = get_source_filename(image_id))) ||
+        (0 != get_file_window(image_id, &window_offset, &window_length, &file_size, &window_image_mode))) {
+        printf("Patch export: the rom file the image was loaded from isn't known\n");
+        g_free(p_source_filename);
         return 0;
     }
 
-    // Open the file
-    file = fopen(filename, "wb");
-    if(!file)
-    {
-        free(rom_gfx.p_data);
+    if (window_image_mode != image_mode) {
+        printf("Patch export: the image was loaded as %s, not %s\n",
+               rom_bin_format_name(window_image_mode), rom_bin_format_name(image_mode));
+        g_free(p_source_filename);
         return 0;
     }
 
-    // Write the data and close it
-    fwrite(rom_gfx.p_data, rom_gfx.size, 1, file);
-    free(rom_gfx.p_data);
-    fclose(file);
+    // Encode the image, it replaces the part of the rom file it was loaded from
+    if (0 != encode_drawable(image_id, drawable_id, image_mode, &tiles)) {
+        g_free(p_source_filename);
+        return 0;
+    }
+
+    // The rom file as it is now is the source to patch
+    if (0 != romimg_file_load(p_source_filename, &source_rom, &source)) {
+        printf("Patch export: can't read the original rom file %s\n", p_source_filename);
+        g_free(p_source_filename);
+        free(tiles.p_data);
+        return 0;
+    }
+
+    target.p_source      = source_rom.p_data;
+    target.source_size   = source_rom.size;
+    target.splice_offset = window_offset;
+    target.splice_length = window_length;
+    target.p_splice      = tiles.p_data;
+    target.splice_size   = tiles.size;
+
+    status = -1;
+
+    if (source_rom.size != file_size)
+        printf("Patch export: %s changed size since the image was loaded from it\n", p_source_filename);
+    else if (NULL != (file = fopen(filename, "wb"))) {
+
+        status = romimg_patch_write(file, patch_format, &target);
+
+        if (0 != fclose(file))
+            status = -1;
+    }
+
+    romimg_file_release(&source_rom, &source);
+    free(tiles.p_data);
+    g_free(p_source_filename);
 
-    return 1;
+    return (0 == status) ? 1 : 0;
 }
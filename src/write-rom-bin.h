@@ -18,4 +18,5 @@
 
 #include <glib.h>
 
-int write_rom_bin(const gchar *, gint, gint, int);
+int write_rom_bin(const gchar *, gint, gint, int, int);
+int write_rom_patch(const gchar *, gint, gint, int, int);